@@ -1,116 +1,1374 @@
 // AVLTree.cpp
 // Jacob Reppeto
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <thread>
+
 #include "AVLTree.hpp"
 
-AVLTree::AVLTree() {
+namespace {
+	/// trees with fewer items than this are traversed on the calling thread
+	const size_t parallelCutoff = 1 << 14;
+	/// subtrees with fewer items than this are not split any further
+	const size_t pieceCutoff = 1 << 12;
+	/// batches with fewer operations than this for a subtree are merged on the current thread
+	const size_t parallelBatchCutoff = 1 << 12;
+	/// diff reports ranges holding at most this many items in both trees instead of splitting them further
+	const size_t diffLeafItems = 8;
+	/// automatic compaction waits for at least this many tombstones, so small trees are not rebuilt over and over
+	const size_t minimumCompactionTombstones = 64;
+	/// number of live items every modification copies for a background compaction
+	const size_t compactionCopyStep = 256;
+	/// a background compaction is swapped in once at most this many logged modifications are left to replay; longer logs are merged into the result on its thread first
+	const size_t compactionSwapLog = 1024;
+	/// number of times a log is merged on the compaction thread before the result is swapped in regardless, in case modifications come faster than they are merged
+	const int compactionMergeRounds = 8;
+
+	/// returns a well mixed 64-bit hash of item (splitmix64 finalizer)
+	uint64_t hashItem(const ItemType& item) {
+		uint64_t hash = static_cast<uint64_t>(std::hash<ItemType>()(item)) + 0x9E3779B97F4A7C15ull;
+		hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+		hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+		return hash ^ (hash >> 31);
+	}
+
+	/// appends value to bytes as a little-endian base-128 varint
+	void writeVarint(std::vector<uint8_t>& bytes, uint64_t value) {
+		while (value >= 0x80) {
+			bytes.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		bytes.push_back(static_cast<uint8_t>(value));
+	}
+
+	/// reads a varint at position of bytes into value and advances position; returns false if bytes ends first
+	bool readVarint(const std::vector<uint8_t>& bytes, size_t& position, uint64_t& value) {
+		value = 0;
+		for (int shift = 0; shift < 64 && position < bytes.size(); shift += 7) {
+			uint8_t byte = bytes[position++];
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// maps an item onto an unsigned value that orders the same way, so gaps between ascending items are non-negative
+	uint64_t itemKey(const ItemType& item) {
+		return static_cast<uint64_t>(static_cast<int64_t>(item)) ^ (static_cast<uint64_t>(1) << 63);
+	}
+
+	/// inverse of itemKey
+	ItemType keyItem(uint64_t key) {
+		return static_cast<ItemType>(static_cast<int64_t>(key ^ (static_cast<uint64_t>(1) << 63)));
+	}
+
+	/// returns the reclaimer that frees the nodes replaced by a compaction in trees without a reclaimer of their own
+	NodeReclaimer& compactionReclaimer() {
+		static NodeReclaimer reclaimer(NodeReclaimer::Background, std::numeric_limits<size_t>::max());
+		return reclaimer;
+	}
+
+	/// threads shared by all parallel traversals, started on first use so a traversal does not pay for creating threads
+	class WorkerPool {
+
+	public:
+		/// returns the pool of the process
+		static WorkerPool& shared() {
+			static WorkerPool pool;
+			return pool;
+		}
+
+		~WorkerPool() {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopping = true;
+			}
+			_wake.notify_all();
+			for (auto& thread : _threads) {
+				thread.join();
+			}
+		}
+
+		/// returns number of threads of the pool
+		size_t threadCount() const { return _threads.size(); }
+
+		/// runs job on one of the threads of the pool
+		void submit(std::function<void()> job) {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_jobs.push_back(std::move(job));
+			}
+			_wake.notify_one();
+		}
+
+	private:
+		/// starts one thread less than there are hardware threads, since the thread starting a traversal works on it too
+		WorkerPool() : _stopping(false) {
+			unsigned int threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+			for (unsigned int i = 0; i < threads; i++) {
+				_threads.emplace_back([this]() { _run(); });
+			}
+		}
+
+		/// runs jobs until the pool is destroyed
+		void _run() {
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (true) {
+				_wake.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+				if (_jobs.empty()) {
+					return;
+				}
+				std::function<void()> job = std::move(_jobs.front());
+				_jobs.pop_front();
+				lock.unlock();
+				job();
+				lock.lock();
+			}
+		}
+
+		/// guards _jobs and _stopping
+		std::mutex _mutex;
+		/// signalled when a job is submitted or the pool is destroyed
+		std::condition_variable _wake;
+		/// jobs not yet picked up by a thread
+		std::deque<std::function<void()>> _jobs;
+		/// set when the threads should finish
+		bool _stopping;
+		std::vector<std::thread> _threads;
+	};
+}
+
+template <typename BalancePolicy>
+BasicAVLTree<BalancePolicy>::BasicAVLTree() {
+	_root = nullptr;
+	_count = 0;
+	_nodeCount = 0;
+	_multiset = false;
+	_hashing = false;
+	_findCacheBits = 0;
+	_findCacheHits = 0;
+	_findCacheMisses = 0;
+	_rotations = 0;
+	_recorder = nullptr;
+	_tombstones = 0;
+	_compactionThreshold = 0;
+	_compactInBackground = true;
+	_compactionCopying = false;
+	_compactionRounds = 0;
+}
+template <typename BalancePolicy>
+BasicAVLTree<BalancePolicy>::BasicAVLTree(bool multiset) {
 	_root = nullptr;
 	_count = 0;
+	_nodeCount = 0;
+	_multiset = multiset;
+	_hashing = false;
+	_findCacheBits = 0;
+	_findCacheHits = 0;
+	_findCacheMisses = 0;
+	_rotations = 0;
+	_recorder = nullptr;
+	_tombstones = 0;
+	_compactionThreshold = 0;
+	_compactInBackground = true;
+	_compactionCopying = false;
+	_compactionRounds = 0;
 }
-AVLTree::AVLTree(const AVLTree& source) {
+template <typename BalancePolicy>
+BasicAVLTree<BalancePolicy>::BasicAVLTree(const BasicAVLTree& source) {
+	// the node type depends on _hashing, so the flags are copied first
+	_multiset = source._multiset;
+	_hashing = source._hashing;
 	_root = _copyNodes(source._root);
 	_count = source._count;
+	_nodeCount = source._nodeCount.load();
+	// the copy gets an empty cache of the same size, since the source's entries refer to the source's nodes
+	_findCache.assign(source._findCache.size(), FindCacheEntry());
+	_findCacheBits = source._findCacheBits;
+	_findCacheHits = 0;
+	_findCacheMisses = 0;
+	_rotations = 0;
+	_recorder = nullptr;
+	_reclaimer = source._reclaimer;
+	_tombstones = source._tombstones.load();
+	_compactionThreshold = source._compactionThreshold;
+	_compactInBackground = source._compactInBackground;
+	_compactionCopying = false;
+	_compactionRounds = 0;
 }
 
-AVLTree& AVLTree::operator=(const AVLTree& source) {
+template <typename BalancePolicy>
+BasicAVLTree<BalancePolicy>& BasicAVLTree<BalancePolicy>::operator=(const BasicAVLTree& source) {
 	if (this != &source) {
 		clear();
+		_multiset = source._multiset;
+		_hashing = source._hashing;
 		_root = _copyNodes(source._root);
 		_count = source._count;
+		_nodeCount = source._nodeCount.load();
+		// like the copy constructor: an empty cache of the source's size
+		_findCache.assign(source._findCache.size(), FindCacheEntry());
+		_findCacheBits = source._findCacheBits;
+		_findCacheHits = 0;
+		_findCacheMisses = 0;
+		_tombstones = source._tombstones.load();
+		_compactionThreshold = source._compactionThreshold;
+		_compactInBackground = source._compactInBackground;
 	}
 	return *this;
 }
 
-void AVLTree::clear() {
-	_root = nullptr;
+template <typename BalancePolicy>
+BasicAVLTree<BalancePolicy>::~BasicAVLTree() {
+	_cancelCompaction();
+	_clearFindCache();
+	_releaseNodes(_root, _nodeCount);
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::clear() {
+	if (_recorder)
+		_recorder->record(TraceEvent::Clear);
+	_stepReclaimer();
+	_cancelCompaction();
+	// cached references would keep nodes from being reclaimed one at a time
+	_clearFindCache();
+	_releaseNodes(_root, _nodeCount);
 	_count = 0;
+	_nodeCount = 0;
+	_tombstones = 0;
+	_arena = nullptr;
 }
 
-void AVLTree::insert(const ItemType& item) {
+template <typename BalancePolicy>
+int BasicAVLTree<BalancePolicy>::height() const {
+	// ranks only bound the height unless they are heights
+	return BalancePolicy::ranksAreHeights ? getHeight(_root) : _heightHelp(_root);
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::insert(const ItemType& item) {
+	if (_recorder)
+		_recorder->record(TraceEvent::Insert, item);
+	_stepReclaimer();
+	_prepareModification({ Modification::Insert, item, 0 });
 	_insertHelp(_root, item);
 }
 
-std::shared_ptr<BinaryTreeNode> AVLTree::find(const ItemType& item) const {
-	return _findHelp(_root, item);
+template <typename BalancePolicy>
+bool BasicAVLTree<BalancePolicy>::eraseOne(const ItemType& item) {
+	if (_recorder)
+		_recorder->record(TraceEvent::Erase, item);
+	_stepReclaimer();
+	_prepareModification({ Modification::Erase, item, 0 });
+	return _eraseHelp(_root, item);
+}
+
+template <typename BalancePolicy>
+bool BasicAVLTree<BalancePolicy>::markDeleted(const ItemType& item) {
+	if (_recorder)
+		_recorder->record(TraceEvent::MarkDeleted, item);
+	_stepReclaimer();
+	_prepareModification({ Modification::MarkDeleted, item, 0 });
+	if (!_markDeletedHelp(item)) {
+		return false;
+	}
+	if (_compactionThreshold > 0 && !isCompacting() && _tombstones >= minimumCompactionTombstones
+		&& _tombstones > _compactionThreshold * static_cast<double>(_nodeCount)) {
+		_startCompaction(_compactInBackground);
+	}
+	return true;
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::setCompactionThreshold(double fraction, bool background) {
+	// in the background, the following modifications copy the live items a few hundred at a time, and another thread rebuilds a balanced tree from the copy in O(n)
+	// the modification that finds the rebuild ready swaps it in after replaying the modifications made to items already copied; a long log is first merged into the result on the other thread, so that replay stays at about a thousand
+	// the old nodes are freed on another thread, or by the tree's reclaimer if it has one
+	_compactionThreshold = std::max(0.0, std::min(fraction, 1.0));
+	_compactInBackground = background;
 }
 
-std::shared_ptr<BinaryTreeNode> AVLTree::minimumNode() const {
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::compact() {
+	_stepReclaimer();
+	// the modifications replayed after a background compaction may leave tombstones of their own
+	_finishCompaction(true);
+	if (_tombstones > 0) {
+		_startCompaction(false);
+	}
+}
+
+template <typename BalancePolicy>
+size_t BasicAVLTree<BalancePolicy>::count(const ItemType& item) const {
+	auto node = find(item);
+	return node ? node->_multiplicity : 0;
+}
+
+template <typename BalancePolicy>
+typename BasicAVLTree<BalancePolicy>::const_iterator& BasicAVLTree<BalancePolicy>::const_iterator::operator++() {
+	// move on to the next node once every copy of the current item has been produced
+	if (++_copy >= _node->_multiplicity) {
+		_copy = 0;
+		_node = _tree->nextLargestNode(_node);
+	}
+	return *this;
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::applyBatch(const std::vector<BatchOperation>& operations) {
+	if (operations.empty()) {
+		return;
+	}
+	if (_recorder) {
+		for (const auto& operation : operations)
+			_recorder->record(operation.kind == BatchOperation::Insert ? TraceEvent::Insert : TraceEvent::Erase, operation.item);
+	}
+	// the batch counts as one modification for a background compaction and for the reclaimer
+	_stepReclaimer();
+	_advanceCompaction();
+	std::vector<Modification> modifications;
+	modifications.reserve(operations.size());
+	for (const auto& operation : operations) {
+		modifications.push_back({ operation.kind == BatchOperation::Insert ? Modification::Insert : Modification::Erase, operation.item, 0 });
+		_logModification(modifications.back());
+	}
+	_mergeModifications(modifications);
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::find(const ItemType& item) const {
+	if (_recorder)
+		_recorder->record(TraceEvent::Find, item);
+	if (_findCache.empty()) {
+		auto node = _findHelp(_root, item);
+		// tombstones are not returned
+		return node && node->_multiplicity > 0 ? node : nullptr;
+	}
+	// entries are dropped when their node leaves the tree, so a matching entry is the node holding item
+	FindCacheEntry& entry = _findCacheEntry(item);
+	if (entry.node && entry.item == item) {
+		_findCacheHits++;
+		return entry.node->_multiplicity > 0 ? entry.node : nullptr;
+	}
+	_findCacheMisses++;
+	auto node = _findHelp(_root, item);
+	if (node) {
+		entry.item = item;
+		entry.node = node;
+	}
+	return node && node->_multiplicity > 0 ? node : nullptr;
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::findUncached(const ItemType& item) const {
+	auto node = _findHelp(_root, item);
+	return node && node->_multiplicity > 0 ? node : nullptr;
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::enableFindCache(size_t slots) {
+	_findCacheBits = 0;
+	while (slots > (static_cast<size_t>(1) << _findCacheBits)) {
+		_findCacheBits++;
+	}
+	_findCache.assign(slots == 0 ? 0 : static_cast<size_t>(1) << _findCacheBits, FindCacheEntry());
+	_findCacheHits = 0;
+	_findCacheMisses = 0;
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::minimumNode() const {
+	if (_recorder)
+		_recorder->record(TraceEvent::Minimum);
 	return _minimumNodeHelp(_root);
 }
 
-std::shared_ptr<BinaryTreeNode> AVLTree::maximumNode() const {
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::maximumNode() const {
+	if (_recorder)
+		_recorder->record(TraceEvent::Maximum);
 	return _maximumNodeHelp(_root);
 }
 
-std::shared_ptr<BinaryTreeNode> AVLTree::nextSmallestNode(std::shared_ptr<BinaryTreeNode> node) const {
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::nextSmallestNode(std::shared_ptr<BinaryTreeNode> node) const {
 	if (node == nullptr)
 		return nullptr;
-	// If there is a left subtree, the next smallest node is the maximum node in that subtree
-	if (node->_leftNode) {
+	if (_recorder)
+		_recorder->record(TraceEvent::NextSmallest, node->_item);
+	// If the left subtree holds live items, the next smallest node is the maximum node in that subtree
+	if (getSize(node->_leftNode) > 0) {
 		return _maximumNodeHelp(node->_leftNode);
 	}
 	// Otherwise, traverse up the tree until we find a node that is the right child of its parent
 	auto current = node;
 	auto parent = current->_parentNode.lock();
-	// while parent is not null and current is the left child of parent
-	while (parent && current == parent->_leftNode) {
+	while (parent) {
+		// current is the right child of parent: parent is smaller, then its left subtree, unless they are tombstones
+		if (current == parent->_rightNode) {
+			if (parent->_multiplicity > 0) {
+				return parent;
+			}
+			if (getSize(parent->_leftNode) > 0) {
+				return _maximumNodeHelp(parent->_leftNode);
+			}
+		}
 		current = parent;
 		parent = parent->_parentNode.lock();
 	}
-	return parent; // This could be nullptr if we reached the root without finding a larger ancestor
+	return nullptr; // We reached the root without finding a smaller live ancestor
 }
 
-std::shared_ptr<BinaryTreeNode> AVLTree::nextLargestNode(std::shared_ptr<BinaryTreeNode> node) const {
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::nextLargestNode(std::shared_ptr<BinaryTreeNode> node) const {
 	if (node == nullptr)
 		return nullptr;
-	// If there is a right subtree, the next largest node is the minimum node in that subtree
-	if (node->_rightNode) {
+	if (_recorder)
+		_recorder->record(TraceEvent::NextLargest, node->_item);
+	// If the right subtree holds live items, the next largest node is the minimum node in that subtree
+	if (getSize(node->_rightNode) > 0) {
 		return _minimumNodeHelp(node->_rightNode);
 	}
 	// Otherwise, traverse up the tree until we find a node that is the left child of its parent
 	auto current = node;
 	auto parent = current->_parentNode.lock();
-	// while parent is not null and current is the right child of parent
-	while (parent && current == parent->_rightNode) {
+	while (parent) {
+		// current is the left child of parent: parent is larger, then its right subtree, unless they are tombstones
+		if (current == parent->_leftNode) {
+			if (parent->_multiplicity > 0) {
+				return parent;
+			}
+			if (getSize(parent->_rightNode) > 0) {
+				return _minimumNodeHelp(parent->_rightNode);
+			}
+		}
 		current = parent;
 		parent = parent->_parentNode.lock();
 	}
-	return parent; // This could be nullptr if we reached the root without finding a larger ancestor
+	return nullptr; // We reached the root without finding a larger live ancestor
 }
 
-std::vector<ItemType> AVLTree::inorder() const {
-	return _inorderHelp(_root);
+template <typename BalancePolicy>
+std::vector<ItemType> BasicAVLTree<BalancePolicy>::inorder() const {
+	std::vector<ItemType> result(_count);
+	exportInorder(result.data());
+	return result;
 }
 
-std::vector<ItemType> AVLTree::preorder() const {
+template <typename BalancePolicy>
+std::vector<ItemType> BasicAVLTree<BalancePolicy>::preorder() const {
+	if (_recorder)
+		_recorder->record(TraceEvent::Preorder);
 	return _preorderHelp(_root);
 }
 
-std::vector<ItemType> AVLTree::postorder() const {
+template <typename BalancePolicy>
+std::vector<ItemType> BasicAVLTree<BalancePolicy>::postorder() const {
+	if (_recorder)
+		_recorder->record(TraceEvent::Postorder);
 	return _postorderHelp(_root);
 }
 
-std::shared_ptr<BinaryTreeNode> AVLTree::_copyNodes(const std::shared_ptr<BinaryTreeNode>& rootNode) const {
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::exportInorder(ItemType* out) const {
+	if (_recorder)
+		_recorder->record(TraceEvent::Inorder);
+	std::vector<TraversalPiece> pieces = _splitForTraversal();
+	_runParallel(pieces.size(), [&](size_t index) {
+		const TraversalPiece& piece = pieces[index];
+		if (piece.wholeSubtree)
+			_exportInorderHelp(piece.node, out + piece.offset);
+		else
+			std::fill_n(out + piece.offset, piece.node->_multiplicity, piece.node->_item);
+	});
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::forEach(const std::function<void(const ItemType&)>& func) const {
+	if (_recorder)
+		_recorder->record(TraceEvent::ForEach);
+	std::vector<TraversalPiece> pieces = _splitForTraversal();
+	_runParallel(pieces.size(), [&](size_t index) {
+		const TraversalPiece& piece = pieces[index];
+		if (piece.wholeSubtree)
+			_forEachHelp(piece.node, func);
+		else
+			for (size_t copy = 0; copy < piece.node->_multiplicity; copy++)
+				func(piece.node->_item);
+	});
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::enableHashing() {
+	if (_hashing) {
+		return;
+	}
+	_stepReclaimer();
+	// a pending compaction builds nodes without digests
+	_cancelCompaction();
+	_hashing = true;
+	if (_root) {
+		// the digest costs 8 bytes per node, which only hashed trees pay: HashedBinaryTreeNode has room for it and BinaryTreeNode does not, so every node is copied into the larger type
+		auto arena = std::make_shared<NodeArena>(_nodeCount);
+		auto hashed = _copyNodes(_root, arena);
+		_rehashHelp(hashed);
+		_clearFindCache();
+		_releaseNodes(_root, _nodeCount);
+		_root = hashed;
+		_arena = arena;
+	}
+}
+
+template <typename BalancePolicy>
+uint64_t BasicAVLTree<BalancePolicy>::rootHash() const {
+	return _subtreeHash(_root);
+}
+
+template <typename BalancePolicy>
+RangeDigest BasicAVLTree<BalancePolicy>::rangeDigest(const ItemType& low, const ItemType& high) const {
+	RangeDigest digest = { 0, 0 };
+	if (!(high < low)) {
+		_rangeDigestHelp(_root, low, high, true, true, digest);
+	}
+	return digest;
+}
+
+template <typename BalancePolicy>
+std::vector<ItemRange> BasicAVLTree<BalancePolicy>::diff(const BasicAVLTree& other) const {
+	std::vector<ItemRange> ranges;
+	_diffHelp(other, std::numeric_limits<ItemType>::lowest(), std::numeric_limits<ItemType>::max(), ranges);
+	return ranges;
+}
+
+template <typename BalancePolicy>
+std::vector<uint8_t> BasicAVLTree<BalancePolicy>::encodeDelta(const std::vector<ItemRange>& ranges) const {
+	// per range: low, high - low, number of nodes, then per node the gap to the previous item and the multiplicity
+	std::vector<uint8_t> delta;
+	writeVarint(delta, ranges.size());
+	for (const auto& range : ranges) {
+		std::vector<std::shared_ptr<BinaryTreeNode>> nodes;
+		_collectRange(_root, range.first, range.second, nodes);
+		writeVarint(delta, itemKey(range.first));
+		writeVarint(delta, itemKey(range.second) - itemKey(range.first));
+		writeVarint(delta, nodes.size());
+		uint64_t previous = itemKey(range.first);
+		for (const auto& node : nodes) {
+			writeVarint(delta, itemKey(node->_item) - previous);
+			writeVarint(delta, node->_multiplicity);
+			previous = itemKey(node->_item);
+		}
+	}
+	return delta;
+}
+
+template <typename BalancePolicy>
+bool BasicAVLTree<BalancePolicy>::applyDelta(const std::vector<uint8_t>& delta) {
+	struct DeltaRange {
+		ItemRange range;
+		std::vector<std::pair<ItemType, uint64_t>> items;
+	};
+	// decode everything first so a malformed delta leaves the tree untouched
+	std::vector<DeltaRange> decoded;
+	size_t position = 0;
+	size_t totalItems = _count;
+	uint64_t rangeCount, low, width, nodeCount, gap, multiplicity;
+	if (!readVarint(delta, position, rangeCount)) {
+		return false;
+	}
+	for (uint64_t r = 0; r < rangeCount; r++) {
+		if (!readVarint(delta, position, low) || !readVarint(delta, position, width) || !readVarint(delta, position, nodeCount)) {
+			return false;
+		}
+		// every node takes at least two bytes, which bounds nodeCount before reserving memory
+		if (nodeCount > (delta.size() - position) / 2 || width > ~low) {
+			return false;
+		}
+		// both ends must be representable as items
+		if (itemKey(keyItem(low)) != low || itemKey(keyItem(low + width)) != low + width) {
+			return false;
+		}
+		DeltaRange range;
+		range.range = ItemRange(keyItem(low), keyItem(low + width));
+		range.items.reserve(nodeCount);
+		uint64_t key = low;
+		for (uint64_t n = 0; n < nodeCount; n++) {
+			if (!readVarint(delta, position, gap) || !readVarint(delta, position, multiplicity)) {
+				return false;
+			}
+			if (gap > low + width - key || (n > 0 && gap == 0) || multiplicity == 0 || multiplicity > BinaryTreeNode::maxMultiplicity || (!_multiset && multiplicity > 1)) {
+				return false;
+			}
+			// the items kept outside the ranges and those added must still be countable
+			if (multiplicity > std::numeric_limits<size_t>::max() - totalItems) {
+				return false;
+			}
+			totalItems += static_cast<size_t>(multiplicity);
+			key += gap;
+			range.items.push_back(std::make_pair(keyItem(key), multiplicity));
+		}
+		decoded.push_back(range);
+	}
+	if (position != delta.size()) {
+		return false;
+	}
+	// every node of a range is set to its multiplicity directly, so hot items cost the same as any other
+	std::vector<Modification> modifications;
+	for (const auto& range : decoded) {
+		std::vector<std::shared_ptr<BinaryTreeNode>> nodes;
+		_collectRange(_root, range.range.first, range.range.second, nodes);
+		auto node = nodes.begin();
+		auto item = range.items.begin();
+		while (node != nodes.end() || item != range.items.end()) {
+			if (item == range.items.end() || (node != nodes.end() && (*node)->_item < item->first)) {
+				modifications.push_back({ Modification::SetCopies, (*node)->_item, 0 });
+				node++;
+			} else if (node == nodes.end() || item->first < (*node)->_item) {
+				modifications.push_back({ Modification::SetCopies, item->first, static_cast<size_t>(item->second) });
+				item++;
+			} else {
+				if ((*node)->_multiplicity != item->second) {
+					modifications.push_back({ Modification::SetCopies, item->first, static_cast<size_t>(item->second) });
+				}
+				node++;
+				item++;
+			}
+		}
+	}
+	if (modifications.empty()) {
+		return true;
+	}
+	_stepReclaimer();
+	_advanceCompaction();
+	for (const auto& modification : modifications) {
+		if (_recorder)
+			_recorder->record(modification.copies == 0 ? TraceEvent::Erase : TraceEvent::Insert, modification.item);
+		_logModification(modification);
+	}
+	_mergeModifications(modifications);
+	return true;
+}
+
+template <typename BalancePolicy>
+MemoryUsage BasicAVLTree<BalancePolicy>::memoryUsage() const {
+	static const size_t heapNodeSize = sharedAllocationSize<BinaryTreeNode>(ItemType());
+	static const size_t hashedHeapNodeSize = sharedAllocationSize<HashedBinaryTreeNode>(ItemType());
+	MemoryUsage usage = { 0, 0, 0 };
+	if (_hashing)
+		_memoryUsageHelp(_root, sizeof(HashedBinaryTreeNode), hashedHeapNodeSize, usage);
+	else
+		_memoryUsageHelp(_root, sizeof(BinaryTreeNode), heapNodeSize, usage);
+	if (_arena) {
+		// slots of the arena that no longer hold a node plus the overhead of the block itself
+		size_t blockSize = _arena->slotSize() * _arena->capacity();
+		usage.allocatorSlackBytes += _arena->slotSize() * (_arena->capacity() - _arena->live());
+		usage.allocatorSlackBytes += mallocChunkSize(blockSize) - blockSize;
+	}
+	return usage;
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::shrinkToFit() {
+	if (!_root) {
+		return;
+	}
+	_stepReclaimer();
+	auto arena = std::make_shared<NodeArena>(_nodeCount);
+	auto compacted = _copyNodes(_root, arena);
+	_clearFindCache();
+	_releaseNodes(_root, _nodeCount);
+	_root = compacted;
+	_arena = arena;
+}
+
+template <typename BalancePolicy>
+typename BasicAVLTree<BalancePolicy>::FindCacheEntry& BasicAVLTree<BalancePolicy>::_findCacheEntry(const ItemType& item) const {
+	// Fibonacci hashing spreads consecutive items over the whole cache
+	uint64_t hash = static_cast<uint64_t>(std::hash<ItemType>()(item)) * 0x9E3779B97F4A7C15ull;
+	return _findCache[_findCacheBits == 0 ? 0 : static_cast<size_t>(hash >> (64 - _findCacheBits))];
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_clearFindCache() {
+	for (auto& entry : _findCache) {
+		entry.node = nullptr;
+	}
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_releaseNodes(std::shared_ptr<BinaryTreeNode>& rootNode, size_t nodeCount) {
+	if (_reclaimer)
+		_reclaimer->retire(std::move(rootNode), nodeCount);
+	rootNode = nullptr;
+}
+
+template <typename BalancePolicy>
+bool BasicAVLTree<BalancePolicy>::_markDeletedHelp(const ItemType& item) {
+	auto node = _findHelp(_root, item);
+	if (!node || node->_multiplicity == 0) {
+		return false;
+	}
+	_count -= node->_multiplicity;
+	node->_multiplicity = 0;
+	_tombstones++;
+	// only sizes and digests change, so the path to the root is updated without rebalancing
+	for (; node; node = node->_parentNode.lock()) {
+		_updateNode(node);
+	}
+	return true;
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_prepareModification(const Modification& modification) {
+	_advanceCompaction();
+	_logModification(modification);
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_advanceCompaction() {
+	if (_compaction.valid()) {
+		_finishCompaction(false);
+	} else if (_compactionCopying && _copyCompactionItems(compactionCopyStep)) {
+		// the rebuild only reads the copied items, so the tree stays usable meanwhile
+		_compactionCopying = false;
+		bool hashing = _hashing;
+		_compaction = std::async(std::launch::async, [items = std::move(_compactionItems), hashing]() { return _buildCompacted(items, hashing); });
+		_compactionItems.clear();
+	}
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_logModification(const Modification& modification) {
+	// items past the last copied one are copied in their new state later, so only modifications of copied items are replayed
+	if (_compaction.valid() || (_compactionCopying && !_compactionItems.empty() && !(_compactionItems.back().item < modification.item))) {
+		_compactionLog.push_back(modification);
+	}
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_startCompaction(bool background) {
+	if (background) {
+		// no modification pays for copying the whole tree; each copies the next few items
+		_compactionCopying = true;
+		_compactionRounds = 0;
+		return;
+	}
+	std::deque<CompactionItem> items;
+	_snapshotHelp(_root, nullptr, std::numeric_limits<size_t>::max(), items);
+	_swapInCompaction(_buildCompacted(items, _hashing));
+}
+
+template <typename BalancePolicy>
+bool BasicAVLTree<BalancePolicy>::_copyCompactionItems(size_t count) {
+	size_t limit = count < std::numeric_limits<size_t>::max() - _compactionItems.size() ? _compactionItems.size() + count : std::numeric_limits<size_t>::max();
+	if (_compactionItems.empty()) {
+		_snapshotHelp(_root, nullptr, limit, _compactionItems);
+	} else {
+		// resume after the last copied item; the cursor is copied since appending may move the items
+		ItemType cursor = _compactionItems.back().item;
+		_snapshotHelp(_root, &cursor, limit, _compactionItems);
+	}
+	return _compactionItems.size() < limit;
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_finishCompaction(bool wait) {
+	if (_compactionCopying) {
+		if (!wait) {
+			return;
+		}
+		// the caller waits anyway, so the rest is copied and rebuilt on this thread
+		_copyCompactionItems(std::numeric_limits<size_t>::max());
+		_compactionCopying = false;
+		std::deque<CompactionItem> items;
+		items.swap(_compactionItems);
+		_swapInCompaction(_buildCompacted(items, _hashing));
+	} else {
+		if (!_compaction.valid()) {
+			return;
+		}
+		if (!wait && _compaction.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			return;
+		}
+		CompactionResult result = _compaction.get();
+		if (!wait && _compactionLog.size() > compactionSwapLog && _compactionRounds < compactionMergeRounds) {
+			// replaying a long log here would stall this modification; the other thread merges it into the result while a new log is kept
+			_compactionRounds++;
+			std::vector<Modification> log;
+			log.swap(_compactionLog);
+			bool multiset = _multiset;
+			bool hashing = _hashing;
+			_compaction = std::async(std::launch::async, [result = std::move(result), log = std::move(log), multiset, hashing]() mutable { return _mergeIntoCompacted(std::move(result), log, multiset, hashing); });
+			return;
+		}
+		_swapInCompaction(result);
+	}
+	_replayCompactionLog();
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_replayCompactionLog() {
+	if (_compactionLog.empty()) {
+		return;
+	}
+	// the result reflects the items as they were copied; one merge brings it up to date and rebalances each affected subtree once, deleted items are removed instead of marked
+	std::vector<Modification> log;
+	log.swap(_compactionLog);
+	_mergeModifications(log);
+}
+
+template <typename BalancePolicy>
+typename BasicAVLTree<BalancePolicy>::CompactionResult BasicAVLTree<BalancePolicy>::_mergeIntoCompacted(CompactionResult result, std::vector<Modification>& log, bool multiset, bool hashing) {
+	// a tree of its own, so the merge touches nothing the tree being modified meanwhile uses
+	BasicAVLTree scratch(multiset);
+	scratch._hashing = hashing;
+	scratch._root = result.root;
+	scratch._nodeCount = result.nodeCount;
+	scratch._mergeModifications(log);
+	result.root = scratch._root;
+	result.nodeCount = scratch._nodeCount;
+	// the nodes belong to the result, not to the scratch tree
+	scratch._root = nullptr;
+	return result;
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_cancelCompaction() {
+	if (_compaction.valid() || !_compactionItems.empty()) {
+		// neither waiting for the rebuild nor freeing its result or the copied items is left to the calling thread; a thread of their own does both and hands the nodes to the reclaimer if there is one
+		std::shared_ptr<NodeReclaimer> reclaimer = _reclaimer;
+		std::thread([compaction = std::move(_compaction), items = std::move(_compactionItems), reclaimer]() mutable {
+			if (compaction.valid()) {
+				CompactionResult result = compaction.get();
+				if (reclaimer)
+					reclaimer->retire(std::move(result.root), result.nodeCount);
+			}
+		}).detach();
+	}
+	_compaction = std::future<CompactionResult>();
+	_compactionItems.clear();
+	_compactionCopying = false;
+	_compactionRounds = 0;
+	_compactionLog.clear();
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_swapInCompaction(CompactionResult result) {
+	_clearFindCache();
+	// the old nodes are freed on another thread, so the modification swapping the result in does not pay for them
+	if (_reclaimer) {
+		_releaseNodes(_root, _nodeCount);
+	} else {
+		compactionReclaimer().retire(std::move(_root), _nodeCount);
+		_root = nullptr;
+	}
+	_root = result.root;
+	_arena = result.arena;
+	_count = getSize(_root);
+	_nodeCount = result.nodeCount;
+	_tombstones = 0;
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_snapshotHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType* after, size_t limit, std::deque<CompactionItem>& items) const {
+	// subtrees of tombstones are skipped as a whole
+	if (getSize(rootNode) == 0 || items.size() >= limit) {
+		return;
+	}
+	// the node and its left subtree are not after the cursor, so only the right subtree is searched
+	if (after && !(*after < rootNode->_item)) {
+		_snapshotHelp(rootNode->_rightNode, after, limit, items);
+		return;
+	}
+	_snapshotHelp(rootNode->_leftNode, after, limit, items);
+	if (rootNode->_multiplicity > 0 && items.size() < limit) {
+		items.push_back({ rootNode->_item, rootNode->_multiplicity });
+	}
+	_snapshotHelp(rootNode->_rightNode, after, limit, items);
+}
+
+template <typename BalancePolicy>
+typename BasicAVLTree<BalancePolicy>::CompactionResult BasicAVLTree<BalancePolicy>::_buildCompacted(const std::deque<CompactionItem>& items, bool hashing) {
+	CompactionResult result;
+	result.arena = std::make_shared<NodeArena>(items.size());
+	result.root = _buildBalanced(items, 0, items.size(), result.arena, hashing);
+	result.nodeCount = items.size();
+	return result;
+}
+
+template <typename BalancePolicy>
+std::vector<typename BasicAVLTree<BalancePolicy>::TraversalPiece> BasicAVLTree<BalancePolicy>::_splitForTraversal() const {
+	std::vector<TraversalPiece> pieces;
+	if (!_root) {
+		return pieces;
+	}
+	if (_count < parallelCutoff) {
+		pieces.push_back({ _root, true, 0 });
+		return pieces;
+	}
+	// split deep enough to hand every worker several pieces so uneven subtrees even out
+	unsigned int workers = std::max(1u, std::thread::hardware_concurrency());
+	int depth = 2;
+	while ((1u << depth) < 4 * workers && depth < 16) {
+		depth++;
+	}
+	_splitHelp(_root, 0, depth, pieces);
+	return pieces;
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_splitHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, size_t offset, int depth, std::vector<TraversalPiece>& pieces) const {
+	if (!rootNode) {
+		return;
+	}
+	// small subtrees and the bottom split level become a single piece
+	if (depth == 0 || rootNode->_size < pieceCutoff) {
+		pieces.push_back({ rootNode, true, offset });
+		return;
+	}
+	size_t leftSize = getSize(rootNode->_leftNode);
+	_splitHelp(rootNode->_leftNode, offset, depth - 1, pieces);
+	pieces.push_back({ rootNode, false, offset + leftSize });
+	_splitHelp(rootNode->_rightNode, offset + leftSize + rootNode->_multiplicity, depth - 1, pieces);
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_runParallel(size_t taskCount, const std::function<void(size_t)>& task) {
+	WorkerPool& pool = WorkerPool::shared();
+	size_t helpers = std::min(taskCount, pool.threadCount() + 1) - (taskCount > 0 ? 1 : 0);
+	if (helpers == 0) {
+		for (size_t index = 0; index < taskCount; index++) {
+			task(index);
+		}
+		return;
+	}
+	// shared with the helpers, which may only start once the calling thread has done every task
+	struct Progress {
+		std::atomic<size_t> nextTask;
+		size_t finishedTasks;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	auto progress = std::make_shared<Progress>();
+	progress->nextTask = 0;
+	progress->finishedTasks = 0;
+	// each thread keeps claiming the next unprocessed task until none are left; task is only touched for a claimed task, while the caller still waits
+	auto worker = [progress, taskCount, &task]() {
+		for (size_t index = progress->nextTask++; index < taskCount; index = progress->nextTask++) {
+			std::exception_ptr error;
+			try {
+				task(index);
+			} catch (...) {
+				error = std::current_exception();
+			}
+			std::lock_guard<std::mutex> lock(progress->mutex);
+			if (error && !progress->error) {
+				progress->error = error;
+			}
+			if (++progress->finishedTasks == taskCount) {
+				progress->done.notify_one();
+			}
+		}
+	};
+	for (size_t i = 0; i < helpers; i++) {
+		pool.submit(worker);
+	}
+	// the calling thread works too, so nested traversals progress even when every pool thread is busy
+	worker();
+	std::unique_lock<std::mutex> lock(progress->mutex);
+	progress->done.wait(lock, [&]() { return progress->finishedTasks == taskCount; });
+	if (progress->error) {
+		std::rethrow_exception(progress->error);
+	}
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_exportInorderHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, ItemType* out) const {
+	if (rootNode) {
+		size_t leftSize = getSize(rootNode->_leftNode);
+		_exportInorderHelp(rootNode->_leftNode, out);
+		std::fill_n(out + leftSize, rootNode->_multiplicity, rootNode->_item);
+		_exportInorderHelp(rootNode->_rightNode, out + leftSize + rootNode->_multiplicity);
+	}
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_forEachHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, const std::function<void(const ItemType&)>& func) const {
+	if (rootNode) {
+		_forEachHelp(rootNode->_leftNode, func);
+		for (size_t copy = 0; copy < rootNode->_multiplicity; copy++)
+			func(rootNode->_item);
+		_forEachHelp(rootNode->_rightNode, func);
+	}
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_makeNode(const ItemType& item) const {
+	return _makeNode(nullptr, item, nullptr, _hashing);
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_makeNode(const std::shared_ptr<NodeArena>& arena, const ItemType& item, const std::shared_ptr<BinaryTreeNode>& leftNode, bool hashed) {
+	// a stateful allocator enlarges the control block, so heap nodes keep using std::make_shared
+	if (!arena) {
+		if (hashed)
+			return std::make_shared<HashedBinaryTreeNode>(item, leftNode);
+		return std::make_shared<BinaryTreeNode>(item, leftNode);
+	}
+	NodeAllocator<BinaryTreeNode> allocator(arena);
+	if (hashed)
+		return std::allocate_shared<HashedBinaryTreeNode>(allocator, item, leftNode);
+	return std::allocate_shared<BinaryTreeNode>(allocator, item, leftNode);
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_updateNode(const std::shared_ptr<BinaryTreeNode>& node) const {
+	if (BalancePolicy::ranksAreHeights) {
+		node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+	}
+	node->_size = node->_multiplicity + getSize(node->_leftNode) + getSize(node->_rightNode);
+	if (_hashing) {
+		_setHash(*node, hashItem(node->_item) * node->_multiplicity + getHash(node->_leftNode) + getHash(node->_rightNode));
+	}
+}
+
+template <typename BalancePolicy>
+uint64_t BasicAVLTree<BalancePolicy>::_subtreeHash(const std::shared_ptr<BinaryTreeNode>& rootNode) const {
+	if (!rootNode) {
+		return 0;
+	}
+	if (_hashing) {
+		return rootNode->hash();
+	}
+	return hashItem(rootNode->_item) * rootNode->_multiplicity + _subtreeHash(rootNode->_leftNode) + _subtreeHash(rootNode->_rightNode);
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_rehashHelp(const std::shared_ptr<BinaryTreeNode>& rootNode) {
+	if (rootNode) {
+		_rehashHelp(rootNode->_leftNode);
+		_rehashHelp(rootNode->_rightNode);
+		_updateNode(rootNode);
+	}
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_rangeDigestHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& low, const ItemType& high, bool lowBounded, bool highBounded, RangeDigest& digest) const {
+	if (!rootNode) {
+		return;
+	}
+	// a subtree entirely inside the range contributes its stored digest
+	if (!lowBounded && !highBounded) {
+		digest.hash += _subtreeHash(rootNode);
+		digest.count += rootNode->_size;
+		return;
+	}
+	if (lowBounded && rootNode->_item < low) {
+		_rangeDigestHelp(rootNode->_rightNode, low, high, lowBounded, highBounded, digest);
+		return;
+	}
+	if (highBounded && rootNode->_item > high) {
+		_rangeDigestHelp(rootNode->_leftNode, low, high, lowBounded, highBounded, digest);
+		return;
+	}
+	// the node is in the range, so its left subtree is below high and its right subtree above low
+	digest.hash += hashItem(rootNode->_item) * rootNode->_multiplicity;
+	digest.count += rootNode->_multiplicity;
+	_rangeDigestHelp(rootNode->_leftNode, low, high, lowBounded, false, digest);
+	_rangeDigestHelp(rootNode->_rightNode, low, high, false, highBounded, digest);
+}
+
+template <typename BalancePolicy>
+size_t BasicAVLTree<BalancePolicy>::_countLess(const std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& item) const {
+	if (!rootNode) {
+		return 0;
+	}
+	if (rootNode->_item < item) {
+		return getSize(rootNode->_leftNode) + rootNode->_multiplicity + _countLess(rootNode->_rightNode, item);
+	}
+	return _countLess(rootNode->_leftNode, item);
+}
+
+template <typename BalancePolicy>
+ItemType BasicAVLTree<BalancePolicy>::_selectHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, size_t index) const {
+	size_t leftSize = getSize(rootNode->_leftNode);
+	if (index < leftSize) {
+		return _selectHelp(rootNode->_leftNode, index);
+	}
+	if (index < leftSize + rootNode->_multiplicity) {
+		return rootNode->_item;
+	}
+	return _selectHelp(rootNode->_rightNode, index - leftSize - rootNode->_multiplicity);
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_diffHelp(const BasicAVLTree& other, const ItemType& low, const ItemType& high, std::vector<ItemRange>& ranges) const {
+	RangeDigest mine = rangeDigest(low, high);
+	RangeDigest theirs = other.rangeDigest(low, high);
+	if (mine == theirs) {
+		return;
+	}
+	if (low == high || (mine.count <= diffLeafItems && theirs.count <= diffLeafItems)) {
+		// extend the previous range if this one continues it
+		if (!ranges.empty() && ranges.back().second < low && ranges.back().second + 1 == low) {
+			ranges.back().second = high;
+		} else {
+			ranges.push_back(ItemRange(low, high));
+		}
+		return;
+	}
+	// split at the median item of whichever tree has more items in the range
+	const BasicAVLTree& larger = mine.count >= theirs.count ? *this : other;
+	size_t median = larger._countLess(larger._root, low) + std::max(mine.count, theirs.count) / 2;
+	ItemType pivot = larger._selectHelp(larger._root, median);
+	if (low < pivot) {
+		_diffHelp(other, low, pivot - 1, ranges);
+		_diffHelp(other, pivot, high, ranges);
+	} else {
+		_diffHelp(other, low, low, ranges);
+		_diffHelp(other, low + 1, high, ranges);
+	}
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_collectRange(const std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& low, const ItemType& high, std::vector<std::shared_ptr<BinaryTreeNode>>& nodes) const {
+	// subtrees of tombstones have nothing to collect
+	if (getSize(rootNode) == 0) {
+		return;
+	}
+	if (low < rootNode->_item) {
+		_collectRange(rootNode->_leftNode, low, high, nodes);
+	}
+	if (!(rootNode->_item < low) && !(high < rootNode->_item) && rootNode->_multiplicity > 0) {
+		nodes.push_back(rootNode);
+	}
+	if (rootNode->_item < high) {
+		_collectRange(rootNode->_rightNode, low, high, nodes);
+	}
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_memoryUsageHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, size_t nodeSize, size_t heapNodeSize, MemoryUsage& usage) const {
+	if (!rootNode) {
+		return;
+	}
+	usage.nodeBytes += nodeSize;
+	if (_arena && _arena->owns(rootNode.get())) {
+		// arena slots are exact, their slack is accounted for once for the whole arena
+		usage.controlBlockBytes += _arena->slotSize() - nodeSize;
+	} else {
+		usage.controlBlockBytes += heapNodeSize - nodeSize;
+		usage.allocatorSlackBytes += mallocChunkSize(heapNodeSize) - heapNodeSize;
+	}
+	_memoryUsageHelp(rootNode->_leftNode, nodeSize, heapNodeSize, usage);
+	_memoryUsageHelp(rootNode->_rightNode, nodeSize, heapNodeSize, usage);
+}
+
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_mergeModifications(std::vector<Modification>& modifications) {
+	// sort by item, keeping the order of the modifications of each item
+	std::stable_sort(modifications.begin(), modifications.end(), [](const Modification& a, const Modification& b) { return a.item < b.item; });
+	// the calling thread merges too, so there is one worker more than the pool has threads
+	size_t workers = WorkerPool::shared().threadCount() + 1;
+	int parallelDepth = 0;
+	while ((static_cast<size_t>(1) << parallelDepth) < workers) {
+		parallelDepth++;
+	}
+	_root = _applyBatchHelp(_root, modifications.data(), modifications.data() + modifications.size(), parallelDepth);
+	if (_root) {
+		_root->_parentNode.reset();
+	}
+	_count = getSize(_root);
+	// removed nodes may still be cached
+	_clearFindCache();
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_applyBatchHelp(std::shared_ptr<BinaryTreeNode> rootNode, const Modification* first, const Modification* last, int parallelDepth) {
+	if (first == last) {
+		return rootNode;
+	}
+	if (!rootNode) {
+		return _buildFromBatch(first, last);
+	}
+	// split the operations into those for the left subtree, for this node and for the right subtree
+	auto less = [](const Modification& modification, const ItemType& item) { return modification.item < item; };
+	auto greater = [](const ItemType& item, const Modification& modification) { return item < modification.item; };
+	const Modification* middle = std::lower_bound(first, last, rootNode->_item, less);
+	const Modification* upper = std::upper_bound(middle, last, rootNode->_item, greater);
+
+	std::shared_ptr<BinaryTreeNode> left, right;
+	if (parallelDepth > 0 && static_cast<size_t>(last - first) >= parallelBatchCutoff) {
+		// the subtrees are disjoint, so they can be merged by separate tasks of the shared pool
+		_runParallel(2, [&](size_t index) {
+			if (index == 0) {
+				left = _applyBatchHelp(rootNode->_leftNode, first, middle, parallelDepth - 1);
+			} else {
+				right = _applyBatchHelp(rootNode->_rightNode, upper, last, parallelDepth - 1);
+			}
+		});
+	} else {
+		left = _applyBatchHelp(rootNode->_leftNode, first, middle, 0);
+		right = _applyBatchHelp(rootNode->_rightNode, upper, last, 0);
+	}
+
+	// a tombstone on the path is either revived or removed
+	if (rootNode->_multiplicity == 0) {
+		_tombstones--;
+	}
+	size_t copies = _batchResult(rootNode->_multiplicity, middle, upper);
+	if (copies == 0) {
+		rootNode->_leftNode = nullptr;
+		rootNode->_rightNode = nullptr;
+		_nodeCount--;
+		return _join2(left, right);
+	}
+	rootNode->_multiplicity = static_cast<uint32_t>(copies);
+	return _join(left, rootNode, right);
+}
+
+template <typename BalancePolicy>
+size_t BasicAVLTree<BalancePolicy>::_batchResult(size_t copies, const Modification* first, const Modification* last) const {
+	for (const Modification* modification = first; modification != last; modification++) {
+		if (modification->kind == Modification::Insert) {
+			copies = _multiset ? std::min<size_t>(copies + 1, BinaryTreeNode::maxMultiplicity) : 1;
+		} else if (modification->kind == Modification::Erase) {
+			copies = copies > 0 ? copies - 1 : 0;
+		} else if (modification->kind == Modification::MarkDeleted) {
+			copies = 0;
+		} else {
+			copies = modification->copies;
+		}
+	}
+	return copies;
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_buildFromBatch(const Modification* first, const Modification* last) {
+	std::vector<CompactionItem> items;
+	while (first != last) {
+		const Modification* next = first;
+		while (next != last && !(first->item < next->item)) {
+			next++;
+		}
+		size_t copies = _batchResult(0, first, next);
+		if (copies > 0) {
+			items.push_back({ first->item, static_cast<uint32_t>(copies) });
+		}
+		first = next;
+	}
+	_nodeCount += items.size();
+	return _buildBalanced(items, 0, items.size(), nullptr, _hashing);
+}
+
+template <typename BalancePolicy>
+template <typename Items>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_buildBalanced(const Items& items, size_t first, size_t last, const std::shared_ptr<NodeArena>& arena, bool hashing) {
+	if (first == last) {
+		return nullptr;
+	}
+	size_t middle = first + (last - first) / 2;
+	// allocate the left subtree first so arena nodes end up in inorder sequence
+	auto leftNode = _buildBalanced(items, first, middle, arena, hashing);
+	auto node = _makeNode(arena, items[middle].item, leftNode, hashing);
+	if (leftNode) {
+		leftNode->_parentNode = node;
+	}
+	node->_rightNode = _buildBalanced(items, middle + 1, last, arena, hashing);
+	if (node->_rightNode) {
+		node->_rightNode->_parentNode = node;
+	}
+	// the halves differ in height by at most one, which satisfies every balancing policy
+	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+	node->_multiplicity = items[middle].multiplicity;
+	node->_size = node->_multiplicity + getSize(node->_leftNode) + getSize(node->_rightNode);
+	if (hashing) {
+		_setHash(*node, hashItem(node->_item) * node->_multiplicity + getHash(node->_leftNode) + getHash(node->_rightNode));
+	}
+	return node;
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_join(std::shared_ptr<BinaryTreeNode> left, const std::shared_ptr<BinaryTreeNode>& node, std::shared_ptr<BinaryTreeNode> right) {
+	// descend the right spine of a much taller left tree and rebalance on the way back up
+	if (getHeight(left) > getHeight(right) + 1) {
+		left->_rightNode = _join(left->_rightNode, node, right);
+		left->_rightNode->_parentNode = left;
+		_rebalanceAfterInsert(left);
+		return left;
+	}
+	// or the left spine of a much taller right tree
+	if (getHeight(right) > getHeight(left) + 1) {
+		right->_leftNode = _join(left, node, right->_leftNode);
+		right->_leftNode->_parentNode = right;
+		_rebalanceAfterInsert(right);
+		return right;
+	}
+	// heights differ by at most one, so node can simply become their parent
+	node->_leftNode = left;
+	node->_rightNode = right;
+	if (left) {
+		left->_parentNode = node;
+	}
+	if (right) {
+		right->_parentNode = node;
+	}
+	node->setHeight(1 + std::max(getHeight(left), getHeight(right)));
+	_updateNode(node);
+	return node;
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_join2(std::shared_ptr<BinaryTreeNode> left, std::shared_ptr<BinaryTreeNode> right) {
+	if (!left) {
+		return right;
+	}
+	if (!right) {
+		return left;
+	}
+	auto minimum = _detachMinimum(right);
+	return _join(left, minimum, right);
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_copyNodes(const std::shared_ptr<BinaryTreeNode>& rootNode, const std::shared_ptr<NodeArena>& arena) const {
 	if (!rootNode) {
 		return nullptr;
 	}
-	// create a new node with the same item as the root node
-	auto newNode = std::make_shared<BinaryTreeNode>(rootNode->_item);
-	// recursively copy the left and right subtrees
-	newNode->_leftNode = _copyNodes(rootNode->_leftNode);
-	if (newNode->_leftNode) {
-		newNode->_leftNode->_parentNode = newNode;
+	// recursively copy the left subtree first, so arena nodes end up in inorder sequence, then create a new node with the same item as the root node
+	auto leftNode = _copyNodes(rootNode->_leftNode, arena);
+	auto newNode = _makeNode(arena, rootNode->_item, leftNode, _hashing);
+	if (leftNode) {
+		leftNode->_parentNode = newNode;
 	}
-	newNode->_rightNode = _copyNodes(rootNode->_rightNode);
+	newNode->_rightNode = _copyNodes(rootNode->_rightNode, arena);
 	if (newNode->_rightNode) {
 		newNode->_rightNode->_parentNode = newNode;
 	}
-	// set the height of the new node
+	// set the height, subtree size and multiplicity of the new node
 	newNode->_height = rootNode->_height;
+	newNode->_size = rootNode->_size;
+	newNode->_multiplicity = rootNode->_multiplicity;
+	if (_hashing) {
+		_setHash(*newNode, rootNode->hash());
+	}
 	return newNode;
 }
 
-std::shared_ptr<BinaryTreeNode> AVLTree::_findHelp(const std::shared_ptr<BinaryTreeNode> rootNode, const ItemType& item) const {
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_findHelp(const std::shared_ptr<BinaryTreeNode> rootNode, const ItemType& item) const {
 	// if the tree is empty, return nullptr
 	if (!rootNode) {
 		return nullptr;
@@ -127,14 +1385,15 @@ std::shared_ptr<BinaryTreeNode> AVLTree::_findHelp(const std::shared_ptr<BinaryT
 	return _findHelp(rootNode->_rightNode, item);
 }
 
-std::shared_ptr<BinaryTreeNode> AVLTree::_minimumNodeHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const {
-	// if the tree is empty, return nullptr
-	if (!rootNode) {
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_minimumNodeHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const {
+	// if the tree is empty or holds only tombstones, return nullptr
+	if (getSize(rootNode) == 0) {
 		return nullptr;
 	}
-	// if there is no left child, return the root node
-	if (!rootNode->_leftNode) {
-		return rootNode;
+	// if the left subtree holds no live item, return the root node unless it is a tombstone
+	if (getSize(rootNode->_leftNode) == 0) {
+		return rootNode->_multiplicity > 0 ? rootNode : _minimumNodeHelp(rootNode->_rightNode);
 	}
 
 	// otherwise, recurse on the left child
@@ -142,24 +1401,28 @@ std::shared_ptr<BinaryTreeNode> AVLTree::_minimumNodeHelp(const std::shared_ptr<
 
 }
 
-std::shared_ptr<BinaryTreeNode> AVLTree::_maximumNodeHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const {
-	// if the tree is empty, return nullptr
-	if (!rootNode) {
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_maximumNodeHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const {
+	// if the tree is empty or holds only tombstones, return nullptr
+	if (getSize(rootNode) == 0) {
 		return nullptr;
 	}
-	// if there is no right child, return the root node
-	if (!rootNode->_rightNode) {
-		return rootNode;
+	// if the right subtree holds no live item, return the root node unless it is a tombstone
+	if (getSize(rootNode->_rightNode) == 0) {
+		return rootNode->_multiplicity > 0 ? rootNode : _maximumNodeHelp(rootNode->_leftNode);
 	}
 	// otherwise, recurse on the right child
 	return _maximumNodeHelp(rootNode->_rightNode);
 }
 
-void AVLTree::_insertHelp(std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& item) {
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_insertHelp(std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& item) {
 	// Base case: if the current node is null, create a new node with the item
 	if (!rootNode) {
-		rootNode = std::make_shared<BinaryTreeNode>(item);
+		rootNode = _makeNode(item);
+		_updateNode(rootNode);
 		_count++;
+		_nodeCount++;
 		return;
 	}
 
@@ -175,60 +1438,145 @@ void AVLTree::_insertHelp(std::shared_ptr<BinaryTreeNode>& rootNode, const ItemT
 			rootNode->_rightNode->_parentNode = rootNode;
 		}
 	} else {
-		// Item already exists in the tree; do not insert duplicates
+		// Item already exists in the tree; a tombstone is revived with a single copy, a multiset counts the copy, otherwise duplicates are not inserted
+		if (rootNode->_multiplicity == 0) {
+			rootNode->_multiplicity = 1;
+			_updateNode(rootNode);
+			_count++;
+			_tombstones--;
+		} else if (_multiset && rootNode->_multiplicity < BinaryTreeNode::maxMultiplicity) {
+			rootNode->_multiplicity++;
+			_updateNode(rootNode);
+			_count++;
+		}
 		return;
 	}
 
-	// Update the height of the current node
-	rootNode->setHeight(1 + std::max(getHeight(rootNode->_leftNode), getHeight(rootNode->_rightNode)));
-	// Calculate the balance factor
-	int balanceFactor = getHeight(rootNode->_leftNode) - getHeight(rootNode->_rightNode);
-	// Perform rotations to maintain AVL property
-	// Left heavy
-	if (balanceFactor > 1) {
-		if (item < rootNode->_leftNode->_item) {
-			// Left-Left case
-			_rightSingleRotate(rootNode);
-		} else {
-			// Left-Right case
-			_leftRightRotate(rootNode);
+	// Update the height and subtree size of the current node and let the balancing policy perform rotations
+	_rebalanceAfterInsert(rootNode);
+}
+
+template <typename BalancePolicy>
+bool BasicAVLTree<BalancePolicy>::_eraseHelp(std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& item) {
+	// Base case: item is not in the tree
+	if (!rootNode) {
+		return false;
+	}
+
+	// Recursive case: find the node holding item
+	bool found;
+	if (item < rootNode->_item) {
+		found = _eraseHelp(rootNode->_leftNode, item);
+	} else if (item > rootNode->_item) {
+		found = _eraseHelp(rootNode->_rightNode, item);
+	} else {
+		// a tombstone holds no copy to remove
+		if (rootNode->_multiplicity == 0) {
+			return false;
 		}
+		found = true;
+		_count--;
+		if (rootNode->_multiplicity > 1) {
+			// other copies remain, so the shape of the tree does not change
+			rootNode->_multiplicity--;
+			_updateNode(rootNode);
+			return true;
+		}
+		auto removed = rootNode;
+		_nodeCount--;
+		// the node leaves the tree, so it must no longer be returned by the cache
+		if (!_findCache.empty()) {
+			FindCacheEntry& entry = _findCacheEntry(item);
+			if (entry.node == removed) {
+				entry.node = nullptr;
+			}
+		}
+		if (!removed->_leftNode || !removed->_rightNode) {
+			// at most one child: the child takes the place of the node
+			rootNode = removed->_leftNode ? removed->_leftNode : removed->_rightNode;
+			if (rootNode) {
+				rootNode->_parentNode = removed->_parentNode;
+			}
+			removed->_leftNode = nullptr;
+			removed->_rightNode = nullptr;
+			return true;
+		}
+		// two children: the successor node takes the place of the node so that no item moves between nodes
+		auto rightNode = removed->_rightNode;
+		auto successor = _detachMinimum(rightNode);
+		successor->_leftNode = removed->_leftNode;
+		successor->_rightNode = rightNode;
+		successor->_parentNode = removed->_parentNode;
+		successor->_height = removed->_height;
+		successor->_leftNode->_parentNode = successor;
+		if (successor->_rightNode) {
+			successor->_rightNode->_parentNode = successor;
+		}
+		removed->_leftNode = nullptr;
+		removed->_rightNode = nullptr;
+		rootNode = successor;
+	}
+	if (!found) {
+		return false;
 	}
 
-	// Right heavy
-	else if (balanceFactor < -1) {
-		if (item > rootNode->_rightNode->_item) {
-			// Right-Right case
-			_leftSingleRotate(rootNode);
-		} else {
-			// Right-Left case
-			_rightLeftRotate(rootNode);
+	// Restore parent pointers of the children, which removal and rotation may have replaced
+	if (rootNode->_leftNode) {
+		rootNode->_leftNode->_parentNode = rootNode;
+	}
+	if (rootNode->_rightNode) {
+		rootNode->_rightNode->_parentNode = rootNode;
+	}
+	_rebalanceAfterErase(rootNode);
+	return true;
+}
+
+template <typename BalancePolicy>
+std::shared_ptr<BinaryTreeNode> BasicAVLTree<BalancePolicy>::_detachMinimum(std::shared_ptr<BinaryTreeNode>& rootNode) {
+	// the minimum has no left child, so its right child takes its place
+	if (!rootNode->_leftNode) {
+		auto minimum = rootNode;
+		rootNode = minimum->_rightNode;
+		if (rootNode) {
+			rootNode->_parentNode = minimum->_parentNode;
 		}
+		minimum->_rightNode = nullptr;
+		return minimum;
 	}
+	auto minimum = _detachMinimum(rootNode->_leftNode);
+	if (rootNode->_leftNode) {
+		rootNode->_leftNode->_parentNode = rootNode;
+	}
+	_rebalanceAfterErase(rootNode);
+	return minimum;
+}
 
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_rebalanceAfterInsert(std::shared_ptr<BinaryTreeNode>& node) {
+	_updateNode(node);
+	BalancePolicy::rebalanceAfterInsert(*this, node);
+}
 
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_rebalanceAfterErase(std::shared_ptr<BinaryTreeNode>& node) {
+	_updateNode(node);
+	BalancePolicy::rebalanceAfterErase(*this, node);
 }
 
-std::vector<ItemType> AVLTree::_inorderHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const {
-	std::vector<ItemType> result;
-	if (rootNode) {
-		// traverse left subtree
-		std::vector<ItemType> leftItems = _inorderHelp(rootNode->_leftNode);
-		result.insert(result.end(), leftItems.begin(), leftItems.end());
-		// goes back to the root to add it to result
-		result.push_back(rootNode->_item);
-		// traverse right subtree
-		std::vector<ItemType> rightItems = _inorderHelp(rootNode->_rightNode);
-		result.insert(result.end(), rightItems.begin(), rightItems.end());
+template <typename BalancePolicy>
+int BasicAVLTree<BalancePolicy>::_heightHelp(const std::shared_ptr<BinaryTreeNode>& rootNode) const {
+	if (!rootNode) {
+		return -1;
 	}
-	return result;
+	return 1 + std::max(_heightHelp(rootNode->_leftNode), _heightHelp(rootNode->_rightNode));
 }
 
-std::vector<ItemType> AVLTree::_preorderHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const {
+template <typename BalancePolicy>
+std::vector<ItemType> BasicAVLTree<BalancePolicy>::_preorderHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const {
 	std::vector<ItemType> result;
 	if (rootNode) {
-		// goes to the root and adds it to result
-		result.push_back(rootNode->_item);
+		// goes to the root and adds every copy of it to result
+		result.insert(result.end(), rootNode->_multiplicity, rootNode->_item);
 		// traverse left subtree
 		std::vector<ItemType> leftItems = _preorderHelp(rootNode->_leftNode);
 		result.insert(result.end(), leftItems.begin(), leftItems.end());
@@ -239,7 +1587,8 @@ std::vector<ItemType> AVLTree::_preorderHelp(const std::shared_ptr<BinaryTreeNod
 	return result;
 }
 
-std::vector<ItemType> AVLTree::_postorderHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const {
+template <typename BalancePolicy>
+std::vector<ItemType> BasicAVLTree<BalancePolicy>::_postorderHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const {
 	std::vector<ItemType> result;
 	if (rootNode) {
 		// traverse left subtree
@@ -248,17 +1597,19 @@ std::vector<ItemType> AVLTree::_postorderHelp(const std::shared_ptr<BinaryTreeNo
 		// traverse right subtree
 		std::vector<ItemType> rightItems = _postorderHelp(rootNode->_rightNode);
 		result.insert(result.end(), rightItems.begin(), rightItems.end());
-		// goes back to the root to add it to result
-		result.push_back(rootNode->_item);
+		// goes back to the root to add every copy of it to result
+		result.insert(result.end(), rootNode->_multiplicity, rootNode->_item);
 	}
 	return result;
 }
 
-void AVLTree::_leftSingleRotate(std::shared_ptr<BinaryTreeNode>& node) {\
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_leftSingleRotate(std::shared_ptr<BinaryTreeNode>& node) {\
 // If the node or its right child is null, return
 	if (!node || !node->_rightNode) return;
 // Store the right child of the node
 	auto right = node->_rightNode;
+	_rotations++;
 	// Update pointers to perform rotation
 	node->_rightNode = right->_leftNode;
 	// Update parent pointers if necessary
@@ -269,19 +1620,21 @@ void AVLTree::_leftSingleRotate(std::shared_ptr<BinaryTreeNode>& node) {\
 	right->_parentNode = node->_parentNode;
 	// Update the original node's parent pointer
 	node->_parentNode = right;
-	// Update heights
-	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+	// Update heights and subtree sizes
+	_updateNode(node);
 	// Set the new root of the subtree
 	node = right;
-	// Update height of the original node after rotation
-	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+	// Update height and subtree size of the original node after rotation
+	_updateNode(node);
 }
 
-void AVLTree::_rightSingleRotate(std::shared_ptr<BinaryTreeNode>& node) {
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_rightSingleRotate(std::shared_ptr<BinaryTreeNode>& node) {
 	// If the node or its left child is null, return
 	if (!node || !node->_leftNode) return;
 	// Store the left child of the node
 	auto left = node->_leftNode;
+	_rotations++;
 	// Update pointers to perform rotation
 	node->_leftNode = left->_rightNode;
 	// Update parent pointers if necessary
@@ -292,15 +1645,16 @@ void AVLTree::_rightSingleRotate(std::shared_ptr<BinaryTreeNode>& node) {
 	left->_parentNode = node->_parentNode;
 	// Update the original node's parent pointer
 	node->_parentNode = left;
-	// Update heights
-	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+	// Update heights and subtree sizes
+	_updateNode(node);
 	// Set the new root of the subtree
 	node = left;
-	// Update height of the original node after rotation
-	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+	// Update height and subtree size of the original node after rotation
+	_updateNode(node);
 }
 
-void AVLTree::_rightLeftRotate(std::shared_ptr<BinaryTreeNode>& node) {
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_rightLeftRotate(std::shared_ptr<BinaryTreeNode>& node) {
 	// If the node or its right child is null, return
 	if (!node || !node->_rightNode) return;
 	// perform right single rotation on the right child
@@ -308,10 +1662,15 @@ void AVLTree::_rightLeftRotate(std::shared_ptr<BinaryTreeNode>& node) {
 	_leftSingleRotate(node);
 }
 
-void AVLTree::_leftRightRotate(std::shared_ptr<BinaryTreeNode>& node) {
+template <typename BalancePolicy>
+void BasicAVLTree<BalancePolicy>::_leftRightRotate(std::shared_ptr<BinaryTreeNode>& node) {
 	// If the node or its left child is null, return
 	if (!node || !node->_leftNode) return;
 	// perform left single rotation on the left child
 	_leftSingleRotate(node->_leftNode);
 	_rightSingleRotate(node);
 }
+
+// the balancing policies the tree is compiled for
+template class BasicAVLTree<AVLBalance>;
+template class BasicAVLTree<WeakAVLBalance>;
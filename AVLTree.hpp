@@ -3,28 +3,129 @@
 #ifndef AVLTree_hpp
 #define AVLTree_hpp
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <utility>
 #include <vector>
 
+#include "BalancePolicy.hpp"
 #include "BinaryTreeNode.hpp"
+#include "NodeArena.hpp"
+#include "NodeReclaimer.hpp"
+#include "TraceRecorder.hpp"
+
+/// digest of the items of a tree within a key range
+struct RangeDigest {
+    /// sum of the hashes of the items in the range; equal for equal contents regardless of tree shape
+    uint64_t hash;
+    /// number of items in the range
+    size_t count;
+
+    bool operator==(const RangeDigest& other) const { return hash == other.hash && count == other.count; }
+    bool operator!=(const RangeDigest& other) const { return !(*this == other); }
+};
+
+/// closed range of items [first, second]
+typedef std::pair<ItemType, ItemType> ItemRange;
+
+/// single insertion or removal applied by BasicAVLTree::applyBatch
+struct BatchOperation {
+    enum Kind { Insert, Erase };
+
+    /// Insert behaves like insert, Erase like eraseOne
+    Kind kind;
+    ItemType item;
+};
+
+/// breakdown of the heap memory held by the nodes of a tree
+struct MemoryUsage {
+    /// bytes occupied by the BinaryTreeNode objects
+    size_t nodeBytes;
+    /// bytes occupied by the shared_ptr control blocks allocated together with the nodes
+    size_t controlBlockBytes;
+    /// bytes the allocator reserves beyond what nodes and control blocks need: malloc chunk headers and rounding, or unused arena slots
+    size_t allocatorSlackBytes;
+
+    /// returns the sum of all categories
+    size_t totalBytes() const { return nodeBytes + controlBlockBytes + allocatorSlackBytes; }
+};
 
-class AVLTree {
+/// self-balancing binary search tree; BalancePolicy selects the balancing rule at compile time, see BalancePolicy.hpp
+template <typename BalancePolicy = AVLBalance>
+class BasicAVLTree {
 
 public:
-    AVLTree();
+    BasicAVLTree();
+
+    /// creates an empty tree
+    /// - Parameter multiset: if true, inserting an item that is already in the tree increments the multiplicity stored in its node instead of being ignored; a node holds at most BinaryTreeNode::maxMultiplicity copies, beyond which further copies are ignored
+    explicit BasicAVLTree(bool multiset);
+
+    /// forward iterator over the items in inorder sequence; an item stored with multiplicity k is produced k times, without materializing the copies
+    class const_iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef ItemType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const ItemType* pointer;
+        typedef const ItemType& reference;
+
+        const_iterator() : _tree(nullptr), _node(nullptr), _copy(0) {}
+
+        reference operator*() const { return _node->_item; }
+        pointer operator->() const { return &_node->_item; }
+        const_iterator& operator++();
+        const_iterator operator++(int) { const_iterator previous = *this; ++*this; return previous; }
+        bool operator==(const const_iterator& other) const { return _node == other._node && _copy == other._copy; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class BasicAVLTree;
+
+        const_iterator(const BasicAVLTree* tree, const std::shared_ptr<BinaryTreeNode>& node) : _tree(tree), _node(node), _copy(0) {}
+
+        /// tree being iterated, used to find the next node
+        const BasicAVLTree* _tree;
+        /// node holding the current item; nullptr at the end
+        std::shared_ptr<BinaryTreeNode> _node;
+        /// index of the current copy of the node's item
+        size_t _copy;
+    };
 
     // MARK: - methods for dynamic memory classes
 
-    /// copy constructor
-    AVLTree(const AVLTree& source);
+    /// copy constructor; the copy gets an empty find cache of the source's size
+    BasicAVLTree(const BasicAVLTree& source);
 
-    /// assignment operator
-    AVLTree& operator=(const AVLTree& source);
+    /// assignment operator; like the copy constructor, the find cache takes the source's size and starts empty
+    BasicAVLTree& operator=(const BasicAVLTree& source);
+
+    /// destructor; hands the nodes to the reclaimer if one is set
+    ~BasicAVLTree();
 
     // MARK: - public methods
 
-    /// returns number of items inserted into the tree
+    /// returns number of items inserted into the tree; items marked as deleted are not counted
     size_t count() const { return _count; }
 
+    /// returns number of copies of item in the tree; 0 or 1 unless the tree is a multiset
+    /// - Parameter item: item to count
+    size_t count(const ItemType& item) const;
+
+    /// returns true if duplicate items are counted instead of ignored
+    bool isMultiset() const { return _multiset; }
+
+    /// returns the height of the tree; -1 if the tree is empty
+    int height() const;
+
+    /// returns the number of single rotations performed since the tree was created; a double rotation counts as two
+    size_t rotationCount() const { return _rotations; }
+
     /// removes all elements from the tree
     void clear();
 
@@ -32,10 +133,73 @@ public:
     /// - Parameter item: item to insert
     void insert(const ItemType& item);
 
+    /// removes one copy of item from the tree and maintains AVL balancing property; the node is removed once its last copy is gone
+    /// - Parameter item: item to remove
+    /// - Returns: true if a copy of item was found and removed
+    bool eraseOne(const ItemType& item);
+
+    /// marks the node holding item as deleted in O(log n) without removing it or rebalancing; every copy of the item is deleted, find, count, traversals, iterators and the successor functions skip the node, and inserting item again revives it; once tombstones exceed the compaction threshold the tree is compacted
+    /// - Parameter item: item to delete
+    /// - Returns: true if item was in the tree
+    bool markDeleted(const ItemType& item);
+
+    /// returns number of nodes marked as deleted and not yet removed
+    size_t tombstoneCount() const { return _tombstones; }
+
+    /// returns number of nodes of the tree, one per distinct item plus one per node marked as deleted
+    size_t nodeCount() const { return _nodeCount; }
+
+    /// compacts the tree automatically once tombstones make up more than fraction of its nodes; every operation sees either the old or the compacted tree
+    /// - Parameters:
+    ///   - fraction: share of tombstones between 0 and 1 that triggers compaction; 0 disables automatic compaction
+    ///   - background: if true the copy is spread over the following modifications and the rebuild runs on another thread, otherwise both happen in the markDeleted that crossed the threshold
+    void setCompactionThreshold(double fraction, bool background = true);
+
+    /// returns true if a background compaction is copying the live items, rebuilding or waiting to be swapped in
+    bool isCompacting() const { return _compactionCopying || _compaction.valid(); }
+
+    /// removes all tombstones now, after finishing a running background compaction if there is one; node pointers obtained before the call refer to the old nodes
+    void compact();
+
+    /// applies a batch of insertions and removals with the same result as applying them one at a time in order; the batch is sorted and merged into the tree in a single pass that rebalances each affected subtree once, processing disjoint subtrees of large batches in parallel
+    /// - Parameter operations: operations to apply
+    void applyBatch(const std::vector<BatchOperation>& operations);
+
     /// returns node containing item or nullptr if not in tree
     /// - Parameter item: item to search for
     std::shared_ptr<BinaryTreeNode> find(const ItemType& item) const;
 
+    /// returns node containing item or nullptr if not in tree, like find, but bypasses the find cache and is not recorded, so the cache contents and hit counts are left as they were
+    /// - Parameter item: item to search for
+    std::shared_ptr<BinaryTreeNode> findUncached(const ItemType& item) const;
+
+    /// puts a direct-mapped cache of recently found nodes in front of find so repeated lookups of hot items skip the descent from the root; find then updates the cache and must not be called concurrently
+    /// - Parameter slots: number of cache entries, rounded up to a power of two; 0 disables the cache
+    void enableFindCache(size_t slots);
+
+    /// returns number of entries in the find cache; 0 if it is disabled
+    size_t findCacheSize() const { return _findCache.size(); }
+
+    /// returns number of find calls answered by the cache
+    size_t findCacheHits() const { return _findCacheHits; }
+
+    /// returns number of find calls with the cache enabled that had to search the tree
+    size_t findCacheMisses() const { return _findCacheMisses; }
+
+    /// records every following operation on the tree, including those made on its behalf by count and iterators, so the workload can be replayed later; the tree does not own the recorder
+    /// - Parameter recorder: recorder to append the operations to, which must outlive its use by the tree; nullptr stops recording
+    void setTraceRecorder(TraceRecorder* recorder) { _recorder = recorder; }
+
+    /// returns the recorder operations are appended to; nullptr if recording is off
+    TraceRecorder* traceRecorder() const { return _recorder; }
+
+    /// frees the nodes dropped by clear, assignment, destruction and shrinkToFit through reclaimer instead of on the calling thread, so those detach the old nodes in O(1); an incremental reclaimer is advanced by every operation that modifies the tree; the reclaimer is shared by copies of the tree and kept alive by them
+    /// - Parameter reclaimer: reclaimer to hand detached nodes to; nullptr frees them immediately
+    void setReclaimer(const std::shared_ptr<NodeReclaimer>& reclaimer) { _reclaimer = reclaimer; }
+
+    /// returns the reclaimer detached nodes are handed to; nullptr if they are freed immediately
+    std::shared_ptr<NodeReclaimer> reclaimer() const { return _reclaimer; }
+
     ///  returns node containing the minimum element; returns nullptr if the tree is empty
     std::shared_ptr<BinaryTreeNode> minimumNode() const;
 
@@ -50,6 +214,12 @@ public:
     /// - Parameter node: node whose item to use to find next largest item
     std::shared_ptr<BinaryTreeNode> nextLargestNode(std::shared_ptr<BinaryTreeNode> node) const;
 
+    /// returns an iterator to the minimum item
+    const_iterator begin() const { return const_iterator(this, minimumNode()); }
+
+    /// returns the iterator past the maximum item
+    const_iterator end() const { return const_iterator(this, nullptr); }
+
     /// returns a vector containing the elements of the tree for an inorder traversal
     std::vector<ItemType> inorder() const;
 
@@ -59,10 +229,349 @@ public:
     /// returns a vector containing the elements of the tree for a postorder traversal
     std::vector<ItemType> postorder() const;
 
+    /// copies the elements of the tree in inorder sequence into a buffer; large trees are split into disjoint subtrees that fill their own slices of the buffer in parallel
+    /// - Parameter out: buffer with room for at least count() items
+    void exportInorder(ItemType* out) const;
+
+    /// calls func once for every element of the tree; large trees are processed in parallel, so func must be safe to call concurrently and the call order is unspecified
+    /// - Parameter func: function to call with each element
+    void forEach(const std::function<void(const ItemType&)>& func) const;
+
+    /// maps every element of the tree and combines the mapped values in inorder sequence; large trees are reduced in parallel, so reduce must be associative and identity must be its identity value
+    /// - Parameters:
+    ///   - map: function converting an element to a Result
+    ///   - reduce: function combining two Results
+    ///   - identity: identity value for reduce, returned for an empty tree
+    template <typename Result, typename Map, typename Reduce>
+    Result mapReduce(Map map, Reduce reduce, Result identity) const;
+
+    /// maintains the digest of every subtree, the sum of a 64-bit hash of each of its items; O(1) on an empty tree, otherwise every node is copied and rehashed in O(n)
+    void enableHashing();
+
+    /// returns true if subtree digests are maintained
+    bool isHashing() const { return _hashing; }
+
+    /// returns the digest of all items; O(1) with hashing enabled, O(n) otherwise
+    uint64_t rootHash() const;
+
+    /// returns the digest of the items in [low, high]; O(log n) with hashing enabled
+    /// - Parameters:
+    ///   - low: smallest item of the range
+    ///   - high: largest item of the range
+    RangeDigest rangeDigest(const ItemType& low, const ItemType& high) const;
+
+    /// returns the ascending, disjoint item ranges in which the contents of this tree and other differ; ranges with equal digests are skipped without visiting their items, and differing ranges are split at their median item until they are small
+    /// - Parameter other: tree to compare with
+    std::vector<ItemRange> diff(const BasicAVLTree& other) const;
+
+    /// returns a compact encoding of the items of this tree within ranges, which applyDelta turns into the contents of those ranges in another tree; items are stored as varint-encoded gaps
+    /// - Parameter ranges: ascending, disjoint ranges to encode, typically from diff
+    std::vector<uint8_t> encodeDelta(const std::vector<ItemRange>& ranges) const;
+
+    /// replaces the items of every range in delta with the items encoded for it; every changed node is given its new multiplicity directly and all ranges are merged into the tree in one pass, so the cost depends on the number of distinct items and not on their copies
+    /// - Parameter delta: encoding produced by encodeDelta
+    /// - Returns: false and leaves the tree unchanged if delta is malformed, an item has more than BinaryTreeNode::maxMultiplicity copies or the tree would hold more items than size_t can count
+    bool applyDelta(const std::vector<uint8_t>& delta);
+
+    /// returns the number of bytes used by the nodes of the tree, their control blocks and allocator overhead; heap overhead is estimated from a typical malloc chunk layout
+    MemoryUsage memoryUsage() const;
+
+    /// moves all nodes into a single contiguous block in inorder sequence to restore locality after heavy churn; node pointers obtained before the call refer to the old nodes
+    void shrinkToFit();
+
 private:
+    friend BalancePolicy;
+
+    /// entry of the find cache; the node is only valid while it is still in the tree
+    struct FindCacheEntry {
+        ItemType item;
+        std::shared_ptr<BinaryTreeNode> node;
+    };
+
+    /// returns the find cache entry item maps to
+    /// - Parameter item: item to look up
+    FindCacheEntry& _findCacheEntry(const ItemType& item) const;
+
+    /// empties every entry of the find cache, keeping its size
+    void _clearFindCache();
+
+    /// live item copied out of the tree for compaction
+    struct CompactionItem {
+        ItemType item;
+        uint32_t multiplicity;
+    };
+
+    /// single modification merged into the tree by _mergeModifications; also logged while a background compaction runs, to be replayed on its result
+    struct Modification {
+        enum Kind { Insert, Erase, MarkDeleted, SetCopies };
+
+        /// Insert behaves like insert, Erase like eraseOne; MarkDeleted and SetCopies remove the node or set its multiplicity
+        Kind kind;
+        ItemType item;
+        /// number of copies SetCopies leaves; 0 removes the node
+        size_t copies;
+    };
+
+    /// tree built by compaction
+    struct CompactionResult {
+        std::shared_ptr<BinaryTreeNode> root;
+        /// number of nodes of the tree
+        size_t nodeCount;
+        /// arena holding the nodes
+        std::shared_ptr<NodeArena> arena;
+    };
+
+    /// marks the node holding item as deleted and updates the path to the root
+    /// - Parameter item: item to delete
+    /// - Returns: true if item was in the tree
+    bool _markDeletedHelp(const ItemType& item);
+
+    /// advances a background compaction and logs the modification about to be made if it has to be replayed on the result
+    /// - Parameter modification: modification about to be made
+    void _prepareModification(const Modification& modification);
+
+    /// copies the next live items for a background compaction, starts the rebuild once all are copied, or swaps in a finished rebuild
+    void _advanceCompaction();
+
+    /// logs a modification about to be made if a background compaction has already copied its item or is rebuilding
+    /// - Parameter modification: modification about to be made
+    void _logModification(const Modification& modification);
+
+    /// starts compacting the tree
+    /// - Parameter background: true to copy the live items over the following modifications, rebuild on another thread and swap the result in later, false to copy, rebuild and swap now
+    void _startCompaction(bool background);
+
+    /// copies live items after the last copied one to _compactionItems
+    /// - Parameter count: maximum number of items to copy
+    /// - Returns: true if every live item has been copied
+    bool _copyCompactionItems(size_t count);
+
+    /// swaps in the result of a background compaction and replays the modifications logged since it started
+    /// - Parameter wait: if false nothing happens unless the rebuild has finished, and a long log is first merged into the result on another thread; if true a copy still in progress is completed and rebuilt on the calling thread
+    void _finishCompaction(bool wait);
+
+    /// applies the modifications logged during a background compaction to its result in one merge
+    void _replayCompactionLog();
+
+    /// returns result with the modifications of log merged in; reads no member of a tree, so it can run on any thread
+    /// - Parameters:
+    ///   - result: tree built by compaction
+    ///   - log: modifications to merge in
+    ///   - multiset: true if the tree counts duplicate items
+    ///   - hashing: true if the nodes maintain digests
+    static CompactionResult _mergeIntoCompacted(CompactionResult result, std::vector<Modification>& log, bool multiset, bool hashing);
+
+    /// discards a background compaction without waiting for it; its result is freed, or handed to the reclaimer, on another thread
+    void _cancelCompaction();
+
+    /// replaces the nodes of the tree with the result of a compaction and hands the old nodes to the tree's reclaimer or, without one, to a background thread
+    /// - Parameter result: tree built from the live items of this tree
+    void _swapInCompaction(CompactionResult result);
+
+    /// appends the live items of the subtree with the specified root to items in inorder sequence, starting after a given item and stopping once items holds limit entries
+    /// - Parameters:
+    ///   - rootNode: root of subtree to copy
+    ///   - after: only items greater than *after are copied; nullptr to start at the smallest item
+    ///   - limit: size of items at which copying stops
+    ///   - items: vector to append the items to
+    void _snapshotHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType* after, size_t limit, std::deque<CompactionItem>& items) const;
+
+    /// returns a balanced tree of new nodes, allocated from one arena, holding items; reads no member of a tree, so it can run on any thread
+    /// - Parameters:
+    ///   - items: items in ascending order
+    ///   - hashing: true to create nodes with digests, as a tree with hashing enabled needs
+    static CompactionResult _buildCompacted(const std::deque<CompactionItem>& items, bool hashing);
+
+    /// frees one step of the nodes an incremental reclaimer holds; called by every operation that modifies the tree
+    void _stepReclaimer() {
+        if (_reclaimer)
+            _reclaimer->step();
+    }
+
+    /// drops the tree's reference to a detached subtree, handing it to the reclaimer if one is set
+    /// - Parameters:
+    ///   - rootNode: root of the subtree, which is nullptr afterwards
+    ///   - nodeCount: number of nodes of the subtree, which the reclaimer accounts its work in
+    void _releaseNodes(std::shared_ptr<BinaryTreeNode>& rootNode, size_t nodeCount);
+
+    /// part of the tree processed by one parallel task: either a whole subtree or just the node itself
+    struct TraversalPiece {
+        std::shared_ptr<BinaryTreeNode> node;
+        bool wholeSubtree;
+        /// inorder position of the first item of the piece
+        size_t offset;
+    };
+
+    /// returns the tree split into pieces whose items are disjoint and in inorder sequence; small trees produce a single piece
+    std::vector<TraversalPiece> _splitForTraversal() const;
+
+    /// splits the subtree with the specified root into pieces
+    /// - Parameters:
+    ///   - rootNode: root of subtree to split
+    ///   - offset: inorder position of the first item of the subtree
+    ///   - depth: number of levels that may still be split
+    ///   - pieces: vector the pieces are appended to
+    void _splitHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, size_t offset, int depth, std::vector<TraversalPiece>& pieces) const;
+
+    /// runs task(0) ... task(taskCount - 1) on the calling thread and the threads of a pool shared by all trees, which is started once per process, and waits for them to finish; exceptions are rethrown on the calling thread
+    /// - Parameters:
+    ///   - taskCount: number of tasks
+    ///   - task: function to run with the index of each task
+    static void _runParallel(size_t taskCount, const std::function<void(size_t)>& task);
+
+    /// copies the items of the subtree with the specified root in inorder sequence into out
+    /// - Parameters:
+    ///   - rootNode: root of subtree to copy
+    ///   - out: buffer to copy the items into
+    void _exportInorderHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, ItemType* out) const;
+
+    /// calls func for every item of the subtree with the specified root
+    /// - Parameters:
+    ///   - rootNode: root of subtree to visit
+    ///   - func: function to call with each element
+    void _forEachHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, const std::function<void(const ItemType&)>& func) const;
+
+    /// inorder map/reduce over the subtree with the specified root
+    /// - Parameters:
+    ///   - rootNode: root of subtree to reduce
+    ///   - map: function converting an element to a Result
+    ///   - reduce: function combining two Results
+    ///   - result: value the mapped items are combined into
+    template <typename Result, typename Map, typename Reduce>
+    void _mapReduceHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, Map& map, Reduce& reduce, Result& result) const;
+
+    /// returns a new heap node holding item, with room for a digest if hashing is enabled
+    /// - Parameter item: item of the node
+    std::shared_ptr<BinaryTreeNode> _makeNode(const ItemType& item) const;
+
+    /// returns a new node holding item, created in arena or on the heap
+    /// - Parameters:
+    ///   - arena: arena to create the node in; nullptr creates it on the heap
+    ///   - item: item of the node
+    ///   - leftNode: left child of the node
+    ///   - hashed: true to create a node with room for a digest
+    static std::shared_ptr<BinaryTreeNode> _makeNode(const std::shared_ptr<NodeArena>& arena, const ItemType& item, const std::shared_ptr<BinaryTreeNode>& leftNode, bool hashed);
+
+    /// stores the digest of a node; does nothing for a node created without room for one
+    /// - Parameters:
+    ///   - node: node to store the digest in
+    ///   - hash: digest of its subtree
+    static void _setHash(BinaryTreeNode& node, uint64_t hash) {
+        if (node._hashed)
+            static_cast<HashedBinaryTreeNode&>(node)._hash = hash;
+    }
+
+    /// recomputes the subtree size, the height if the policy's ranks are heights and, if hashing is enabled, the digest of node from its children
+    /// - Parameter node: node to update
+    void _updateNode(const std::shared_ptr<BinaryTreeNode>& node) const;
+
+    /// adds the memory used by the nodes of the subtree with the specified root to usage
+    /// - Parameters:
+    ///   - rootNode: root of subtree to account for
+    ///   - nodeSize: bytes of one node object
+    ///   - heapNodeSize: bytes of one heap allocation holding a node and its control block
+    ///   - usage: totals to add to
+    void _memoryUsageHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, size_t nodeSize, size_t heapNodeSize, MemoryUsage& usage) const;
+
+    /// returns the digest of the subtree with the specified root, computing it if hashing is disabled
+    /// - Parameter rootNode: root of subtree
+    uint64_t _subtreeHash(const std::shared_ptr<BinaryTreeNode>& rootNode) const;
+
+    /// recomputes the digests of every node in the subtree with the specified root
+    /// - Parameter rootNode: root of subtree
+    void _rehashHelp(const std::shared_ptr<BinaryTreeNode>& rootNode);
+
+    /// adds the items of the subtree with the specified root that lie in [low, high] to digest
+    /// - Parameters:
+    ///   - rootNode: root of subtree
+    ///   - low: smallest item of the range
+    ///   - high: largest item of the range
+    ///   - lowBounded: false if every item of the subtree is known to be at least low
+    ///   - highBounded: false if every item of the subtree is known to be at most high
+    ///   - digest: digest to add to
+    void _rangeDigestHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& low, const ItemType& high, bool lowBounded, bool highBounded, RangeDigest& digest) const;
+
+    /// returns the number of items less than item in the subtree with the specified root
+    /// - Parameters:
+    ///   - rootNode: root of subtree
+    ///   - item: item to compare with
+    size_t _countLess(const std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& item) const;
+
+    /// returns the item at inorder position index of the subtree with the specified root
+    /// - Parameters:
+    ///   - rootNode: root of subtree containing more than index items
+    ///   - index: inorder position, counting every copy of an item
+    ItemType _selectHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, size_t index) const;
+
+    /// appends the ranges within [low, high] in which this tree and other differ
+    /// - Parameters:
+    ///   - other: tree to compare with
+    ///   - low: smallest item of the range
+    ///   - high: largest item of the range
+    ///   - ranges: vector to append the ranges to
+    void _diffHelp(const BasicAVLTree& other, const ItemType& low, const ItemType& high, std::vector<ItemRange>& ranges) const;
+
+    /// appends the live nodes of the subtree with the specified root whose items lie in [low, high] to nodes in inorder sequence
+    /// - Parameters:
+    ///   - rootNode: root of subtree
+    ///   - low: smallest item of the range
+    ///   - high: largest item of the range
+    ///   - nodes: vector to append the nodes to
+    void _collectRange(const std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& low, const ItemType& high, std::vector<std::shared_ptr<BinaryTreeNode>>& nodes) const;
+
+    /// sorts modifications by item, keeping the order of those on the same item, and merges them into the tree in a single pass
+    /// - Parameter modifications: modifications to apply; sorted in place
+    void _mergeModifications(std::vector<Modification>& modifications);
+
+    /// merges the sorted operations into the subtree with the specified root and returns the new root
+    /// - Parameters:
+    ///   - rootNode: root of subtree to merge into
+    ///   - first: first operation for the subtree
+    ///   - last: end of the operations for the subtree
+    ///   - parallelDepth: number of levels that may still hand a subtree to the shared pool
+    std::shared_ptr<BinaryTreeNode> _applyBatchHelp(std::shared_ptr<BinaryTreeNode> rootNode, const Modification* first, const Modification* last, int parallelDepth);
+
+    /// returns the number of copies of an item after applying its operations one at a time
+    /// - Parameters:
+    ///   - copies: number of copies before the operations
+    ///   - first: first operation on the item
+    ///   - last: end of the operations on the item
+    size_t _batchResult(size_t copies, const Modification* first, const Modification* last) const;
+
+    /// returns a balanced tree of new nodes holding the items the sorted operations leave behind when none of them is in the tree yet
+    /// - Parameters:
+    ///   - first: first operation
+    ///   - last: end of the operations
+    std::shared_ptr<BinaryTreeNode> _buildFromBatch(const Modification* first, const Modification* last);
+
+    /// returns a balanced tree of new nodes holding items[first, last)
+    /// - Parameters:
+    ///   - items: items in ascending order, each with its multiplicity
+    ///   - first: index of the first item of the tree
+    ///   - last: index past the last item of the tree
+    ///   - arena: arena to create the nodes in; nullptr creates them on the heap
+    ///   - hashing: true to create nodes with digests and compute them
+    template <typename Items>
+    static std::shared_ptr<BinaryTreeNode> _buildBalanced(const Items& items, size_t first, size_t last, const std::shared_ptr<NodeArena>& arena, bool hashing);
+
+    /// returns the root of a balanced tree holding the items of left, node and right, rebalancing only along the spine where the smaller tree is attached
+    /// - Parameters:
+    ///   - left: tree whose items are all less than node's
+    ///   - node: node to join with
+    ///   - right: tree whose items are all greater than node's
+    std::shared_ptr<BinaryTreeNode> _join(std::shared_ptr<BinaryTreeNode> left, const std::shared_ptr<BinaryTreeNode>& node, std::shared_ptr<BinaryTreeNode> right);
+
+    /// returns the root of a balanced tree holding the items of left and right
+    /// - Parameters:
+    ///   - left: tree whose items are all less than right's
+    ///   - right: tree whose items are all greater than left's
+    std::shared_ptr<BinaryTreeNode> _join2(std::shared_ptr<BinaryTreeNode> left, std::shared_ptr<BinaryTreeNode> right);
+
     /// returns a new shallow copy of a tree rooted at rootNode
-    /// - Parameter rootNode: root of subtree to copy
-    std::shared_ptr<BinaryTreeNode> _copyNodes(const std::shared_ptr<BinaryTreeNode>& rootNode) const;
+    /// - Parameters:
+    ///   - rootNode: root of subtree to copy
+    ///   - arena: arena to create the nodes in, in inorder sequence; nullptr creates them on the heap
+    std::shared_ptr<BinaryTreeNode> _copyNodes(const std::shared_ptr<BinaryTreeNode>& rootNode, const std::shared_ptr<NodeArena>& arena = nullptr) const;
 
     /// returns the node containing item or nullptr if not found in the subtree with specified root
     /// - Parameters:
@@ -70,11 +579,11 @@ private:
     ///   - item: item to search for
     std::shared_ptr<BinaryTreeNode> _findHelp(const std::shared_ptr<BinaryTreeNode> rootNode, const ItemType& item) const;
 
-    /// returns the node containing the minimum node in tree with specified root
+    /// returns the node containing the minimum live item in tree with specified root; nullptr if it holds only tombstones
     /// - Parameter rootNode: root of subtree to find the minimum in
     std::shared_ptr<BinaryTreeNode> _minimumNodeHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const;
 
-    /// returns the node containing the maximum node in tree with specified root
+    /// returns the node containing the maximum live item in tree with specified root; nullptr if it holds only tombstones
     /// - Parameter rootNode: root of subtree to find the maximum in
     std::shared_ptr<BinaryTreeNode> _maximumNodeHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const;
 
@@ -84,9 +593,28 @@ private:
     ///   - item: item to insert
     void _insertHelp(std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& item);
 
-    /// inorder traversal helper
-    /// - Parameter rootNode: root of subtree to run traversal on
-    std::vector<ItemType> _inorderHelp(const std::shared_ptr<BinaryTreeNode> rootNode) const;
+    /// removes one copy of item from the tree rooted at rootNode
+    /// - Parameters:
+    ///   - rootNode: rootNode of tree to remove from which is passed by reference since removal and rotation may change it
+    ///   - item: item to remove
+    /// - Returns: true if a copy of item was found
+    bool _eraseHelp(std::shared_ptr<BinaryTreeNode>& rootNode, const ItemType& item);
+
+    /// unlinks the node with the minimum item from the tree rooted at rootNode, rebalancing on the way up, and returns it
+    /// - Parameter rootNode: rootNode of non-empty tree which is passed by reference since removal and rotation may change it
+    std::shared_ptr<BinaryTreeNode> _detachMinimum(std::shared_ptr<BinaryTreeNode>& rootNode);
+
+    /// updates node and lets the balancing policy restore balance at it after the subtree of a child may have grown
+    /// - Parameter node: node to rebalance which is passed by reference since rotation may change it
+    void _rebalanceAfterInsert(std::shared_ptr<BinaryTreeNode>& node);
+
+    /// updates node and lets the balancing policy restore balance at it after the subtree of a child may have shrunk
+    /// - Parameter node: node to rebalance which is passed by reference since rotation may change it
+    void _rebalanceAfterErase(std::shared_ptr<BinaryTreeNode>& node);
+
+    /// returns the height of the subtree with the specified root
+    /// - Parameter rootNode: root of subtree
+    int _heightHelp(const std::shared_ptr<BinaryTreeNode>& rootNode) const;
 
     /// preorder traversal helper
     /// - Parameter rootNode: root of subtree to run traversal on
@@ -116,6 +644,86 @@ private:
     std::shared_ptr<BinaryTreeNode> _root;
     /// number of items in the tree
     size_t _count;
+    /// number of nodes in the tree, including tombstones; atomic since applyBatch adds and removes nodes in subtrees in parallel
+    std::atomic<size_t> _nodeCount;
+    /// true if duplicate items are counted instead of ignored
+    bool _multiset;
+    /// true if nodes maintain the digest of their subtree
+    bool _hashing;
+    /// direct-mapped cache of found nodes; empty if disabled
+    mutable std::vector<FindCacheEntry> _findCache;
+    /// number of bits of the item hash used to index _findCache
+    int _findCacheBits;
+    /// number of find calls answered by the cache
+    mutable size_t _findCacheHits;
+    /// number of find calls that missed the cache
+    mutable size_t _findCacheMisses;
+    /// block the nodes were moved into by the last shrinkToFit; nullptr if there was none since the last clear
+    std::shared_ptr<NodeArena> _arena;
+    /// number of single rotations; atomic since applyBatch rebalances subtrees in parallel
+    std::atomic<size_t> _rotations;
+    /// recorder the operations are appended to or nullptr; not copied with the tree
+    TraceRecorder* _recorder;
+    /// reclaimer detached nodes are handed to or nullptr
+    std::shared_ptr<NodeReclaimer> _reclaimer;
+    /// number of nodes marked as deleted; atomic since applyBatch removes them from subtrees in parallel
+    std::atomic<size_t> _tombstones;
+    /// share of tombstones that triggers compaction; 0 if only compact() compacts
+    double _compactionThreshold;
+    /// true if automatic compaction rebuilds the tree on another thread
+    bool _compactInBackground;
+    /// true while the modifications copy the live items for a background compaction
+    bool _compactionCopying;
+    /// live items copied so far by the background compaction, in ascending order; a deque grows in small blocks, so no step makes one large allocation
+    std::deque<CompactionItem> _compactionItems;
+    /// number of times the log has been merged into the result of the running background compaction on its thread
+    int _compactionRounds;
+    /// result of the running background rebuild; not valid if none is running
+    std::future<CompactionResult> _compaction;
+    /// modifications to be replayed on the result of the background compaction
+    std::vector<Modification> _compactionLog;
 };
 
+/// tree with classic AVL balancing
+typedef BasicAVLTree<AVLBalance> AVLTree;
+
+/// tree with weak AVL (rank-balanced) balancing, which rotates less on removal
+typedef BasicAVLTree<WeakAVLBalance> WAVLTree;
+
+template <typename BalancePolicy>
+template <typename Result, typename Map, typename Reduce>
+Result BasicAVLTree<BalancePolicy>::mapReduce(Map map, Reduce reduce, Result identity) const {
+    if (_recorder)
+        _recorder->record(TraceEvent::ForEach);
+    std::vector<TraversalPiece> pieces = _splitForTraversal();
+    std::vector<Result> partials(pieces.size(), identity);
+    _runParallel(pieces.size(), [&](size_t index) {
+        const TraversalPiece& piece = pieces[index];
+        if (piece.wholeSubtree)
+            _mapReduceHelp(piece.node, map, reduce, partials[index]);
+        else
+            for (size_t copy = 0; copy < piece.node->_multiplicity; copy++)
+                partials[index] = reduce(std::move(partials[index]), map(piece.node->_item));
+    });
+    // combine the partial results in inorder sequence
+    Result result = identity;
+    for (const auto& partial : partials)
+        result = reduce(std::move(result), partial);
+    return result;
+}
+
+template <typename BalancePolicy>
+template <typename Result, typename Map, typename Reduce>
+void BasicAVLTree<BalancePolicy>::_mapReduceHelp(const std::shared_ptr<BinaryTreeNode>& rootNode, Map& map, Reduce& reduce, Result& result) const {
+    if (rootNode) {
+        _mapReduceHelp(rootNode->_leftNode, map, reduce, result);
+        if (rootNode->_multiplicity > 0) {
+            Result mapped = map(rootNode->_item);
+            for (size_t copy = 0; copy < rootNode->_multiplicity; copy++)
+                result = reduce(std::move(result), mapped);
+        }
+        _mapReduceHelp(rootNode->_rightNode, map, reduce, result);
+    }
+}
+
 #endif /* AVLTree_hpp */
\ No newline at end of file
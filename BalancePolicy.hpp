@@ -0,0 +1,175 @@
+// BalancePolicy.hpp
+
+#ifndef BalancePolicy_hpp
+#define BalancePolicy_hpp
+
+#include <memory>
+
+#include "BinaryTreeNode.hpp"
+
+// A balancing policy decides how BasicAVLTree restores balance after its shape changed below a node. It is a
+// struct with
+//   - ranksAreHeights: true if a node's rank (stored as its height) is always 1 + the larger rank of its children,
+//     in which case the tree recomputes it whenever it updates a node
+//   - rebalanceAfterInsert(tree, node): called on every node of the path back to the root after the subtree of one
+//     child of node may have grown, including after a join attached a tree below node
+//   - rebalanceAfterErase(tree, node): called on every node of the path back to the root after the subtree of one
+//     child of node may have shrunk
+// Both functions may rotate with the tree's rotation helpers, which replace node with the new root of the subtree.
+
+/// classic AVL balancing: the heights of the children of every node differ by at most one; keeps trees shallowest, at the cost of up to O(log n) rotations per removal
+struct AVLBalance {
+    static const bool ranksAreHeights = true;
+
+    template <typename Tree>
+    static void rebalanceAfterInsert(Tree& tree, std::shared_ptr<BinaryTreeNode>& node) { rebalance(tree, node); }
+
+    template <typename Tree>
+    static void rebalanceAfterErase(Tree& tree, std::shared_ptr<BinaryTreeNode>& node) { rebalance(tree, node); }
+
+    /// restores the AVL property at node using the balance factors of its children
+    template <typename Tree>
+    static void rebalance(Tree& tree, std::shared_ptr<BinaryTreeNode>& node);
+};
+
+/// weak AVL (rank-balanced) balancing: every node has a rank, the rank differences to its children are 1 or 2 and leaves have rank 0; insertion behaves like AVL, but removal needs at most two rotations and O(1) amortized rank changes, and trees are at most about 2 log2(n) high
+struct WeakAVLBalance {
+    static const bool ranksAreHeights = false;
+
+    template <typename Tree>
+    static void rebalanceAfterInsert(Tree& tree, std::shared_ptr<BinaryTreeNode>& node);
+
+    template <typename Tree>
+    static void rebalanceAfterErase(Tree& tree, std::shared_ptr<BinaryTreeNode>& node);
+};
+
+template <typename Tree>
+void AVLBalance::rebalance(Tree& tree, std::shared_ptr<BinaryTreeNode>& node) {
+    int balanceFactor = getHeight(node->leftNode()) - getHeight(node->rightNode());
+    // Left heavy
+    if (balanceFactor > 1) {
+        auto left = node->leftNode();
+        if (getHeight(left->leftNode()) >= getHeight(left->rightNode())) {
+            // Left-Left case
+            tree._rightSingleRotate(node);
+        } else {
+            // Left-Right case
+            tree._leftRightRotate(node);
+        }
+    }
+    // Right heavy
+    else if (balanceFactor < -1) {
+        auto right = node->rightNode();
+        if (getHeight(right->rightNode()) >= getHeight(right->leftNode())) {
+            // Right-Right case
+            tree._leftSingleRotate(node);
+        } else {
+            // Right-Left case
+            tree._rightLeftRotate(node);
+        }
+    }
+}
+
+template <typename Tree>
+void WeakAVLBalance::rebalanceAfterInsert(Tree& tree, std::shared_ptr<BinaryTreeNode>& node) {
+    const int rank = node->height();
+    auto left = node->leftNode();
+    auto right = node->rightNode();
+    // a child with the same rank as node (a 0-child) violates the rank rule
+    if (getHeight(left) == rank) {
+        if (rank - getHeight(right) == 1) {
+            // promote node; the violation may move up to its parent
+            node->setHeight(rank + 1);
+            return;
+        }
+        auto outer = left->leftNode();
+        auto inner = left->rightNode();
+        if (rank - getHeight(outer) == 1 && rank - getHeight(inner) == 1) {
+            // left is a 1,1 node, which only a join creates: rotate and promote left, node keeps its rank
+            tree._rightSingleRotate(node);
+            node->setHeight(rank + 1);
+        } else if (rank - getHeight(inner) == 2) {
+            // single rotation, then demote the old root
+            tree._rightSingleRotate(node);
+            node->rightNode()->setHeight(rank - 1);
+        } else {
+            // double rotation: inner becomes the root with the old rank, both of its new children are demoted
+            tree._leftRightRotate(node);
+            node->setHeight(rank);
+            node->leftNode()->setHeight(rank - 1);
+            node->rightNode()->setHeight(rank - 1);
+        }
+    } else if (getHeight(right) == rank) {
+        if (rank - getHeight(left) == 1) {
+            node->setHeight(rank + 1);
+            return;
+        }
+        auto outer = right->rightNode();
+        auto inner = right->leftNode();
+        if (rank - getHeight(outer) == 1 && rank - getHeight(inner) == 1) {
+            tree._leftSingleRotate(node);
+            node->setHeight(rank + 1);
+        } else if (rank - getHeight(inner) == 2) {
+            tree._leftSingleRotate(node);
+            node->leftNode()->setHeight(rank - 1);
+        } else {
+            tree._rightLeftRotate(node);
+            node->setHeight(rank);
+            node->leftNode()->setHeight(rank - 1);
+            node->rightNode()->setHeight(rank - 1);
+        }
+    }
+}
+
+template <typename Tree>
+void WeakAVLBalance::rebalanceAfterErase(Tree& tree, std::shared_ptr<BinaryTreeNode>& node) {
+    const int rank = node->height();
+    auto left = node->leftNode();
+    auto right = node->rightNode();
+    // leaves must have rank 0
+    if (!left && !right) {
+        node->setHeight(0);
+        return;
+    }
+    // otherwise only a child whose rank is 3 below node's (a 3-child) violates the rank rule
+    bool leftShrunk = rank - getHeight(left) == 3;
+    if (!leftShrunk && rank - getHeight(right) != 3) {
+        return;
+    }
+    auto sibling = leftShrunk ? right : left;
+    if (rank - getHeight(sibling) == 2) {
+        // demote node; it may now be a 3-child of its parent
+        node->setHeight(rank - 1);
+        return;
+    }
+    auto outer = leftShrunk ? sibling->rightNode() : sibling->leftNode();
+    auto inner = leftShrunk ? sibling->leftNode() : sibling->rightNode();
+    const int siblingRank = sibling->height();
+    if (siblingRank - getHeight(outer) == 2 && siblingRank - getHeight(inner) == 2) {
+        // demote node and its 2,2 sibling
+        node->setHeight(rank - 1);
+        sibling->setHeight(siblingRank - 1);
+        return;
+    }
+    if (siblingRank - getHeight(outer) == 1) {
+        // single rotation: the sibling is promoted to the old rank, the old root demoted, to 0 if it became a leaf
+        if (leftShrunk)
+            tree._leftSingleRotate(node);
+        else
+            tree._rightSingleRotate(node);
+        node->setHeight(rank);
+        auto demoted = leftShrunk ? node->leftNode() : node->rightNode();
+        demoted->setHeight(demoted->leftNode() || demoted->rightNode() ? rank - 1 : 0);
+    } else {
+        // double rotation: inner becomes the root with the old rank, its new children drop by two
+        if (leftShrunk)
+            tree._rightLeftRotate(node);
+        else
+            tree._leftRightRotate(node);
+        node->setHeight(rank);
+        node->leftNode()->setHeight(rank - 2);
+        node->rightNode()->setHeight(rank - 2);
+    }
+}
+
+#endif /* BalancePolicy_hpp */
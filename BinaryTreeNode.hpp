@@ -3,6 +3,7 @@
 #ifndef BinaryTreeNode_hpp
 #define BinaryTreeNode_hpp
 
+#include <cstdint>
 #include <iostream>
 
 #include <memory>
@@ -10,9 +11,14 @@
 typedef int ItemType;
 
 class BinaryTreeNode {
-    friend class AVLTree;
+    template <typename BalancePolicy> friend class BasicAVLTree;
+    friend class NodeReclaimer;
+    friend class HashedBinaryTreeNode;
 
 public:
+    /// largest number of copies of an item a node can hold
+    static constexpr uint32_t maxMultiplicity = 0xFFFFFFFFu;
+
     BinaryTreeNode(const ItemType item,
         const std::shared_ptr<BinaryTreeNode> leftNode = nullptr,
         const std::shared_ptr<BinaryTreeNode> rightNode = nullptr,
@@ -20,7 +26,13 @@ public:
 
     int height() const { return _height; }
     void setHeight(const int height) { _height = height; }
+    size_t size() const { return _size; }
+    size_t multiplicity() const { return _multiplicity; }
+    /// returns the digest of the subtree rooted at this node; 0 unless the node belongs to a tree with hashing enabled
+    uint64_t hash() const;
     ItemType item() const { return _item; }
+    std::shared_ptr<BinaryTreeNode> leftNode() const { return _leftNode; }
+    std::shared_ptr<BinaryTreeNode> rightNode() const { return _rightNode; }
 
 
     //     ~BinaryTreeNode() noexcept { std::cerr << "deallocate BinaryTreeNode " << _item << std::endl; }
@@ -28,10 +40,29 @@ public:
 
 private:
     ItemType _item;
+    int _height;
     std::shared_ptr<BinaryTreeNode> _leftNode;
     std::shared_ptr<BinaryTreeNode> _rightNode;
     std::weak_ptr<BinaryTreeNode> _parentNode;
-    int _height;
+    /// number of items in the subtree rooted at this node, counting each copy of a duplicate item
+    size_t _size;
+    /// number of copies of _item stored in this node; only exceeds 1 in multiset mode
+    uint32_t _multiplicity;
+    /// true if the node is a HashedBinaryTreeNode; fills padding, so it costs no space
+    bool _hashed;
+};
+
+/// node of a tree with hashing enabled; the digest lives here so nodes of other trees do not carry it
+class HashedBinaryTreeNode : public BinaryTreeNode {
+    template <typename BalancePolicy> friend class BasicAVLTree;
+    friend class BinaryTreeNode;
+
+public:
+    explicit HashedBinaryTreeNode(const ItemType item, const std::shared_ptr<BinaryTreeNode> leftNode = nullptr);
+
+private:
+    /// order-independent digest of the items in the subtree rooted at this node
+    uint64_t _hash;
 };
 
 inline BinaryTreeNode::BinaryTreeNode(const ItemType item,
@@ -43,6 +74,18 @@ inline BinaryTreeNode::BinaryTreeNode(const ItemType item,
     _rightNode = rightNode;
     _parentNode = parentNode;
     _height = 0;
+    _size = 1;
+    _multiplicity = 1;
+    _hashed = false;
+}
+
+inline HashedBinaryTreeNode::HashedBinaryTreeNode(const ItemType item, const std::shared_ptr<BinaryTreeNode> leftNode) : BinaryTreeNode(item, leftNode) {
+    _hashed = true;
+    _hash = 0;
+}
+
+inline uint64_t BinaryTreeNode::hash() const {
+    return _hashed ? static_cast<const HashedBinaryTreeNode*>(this)->_hash : 0;
 }
 
 inline int getHeight(const std::shared_ptr<BinaryTreeNode> node) {
@@ -52,4 +95,18 @@ inline int getHeight(const std::shared_ptr<BinaryTreeNode> node) {
         return node->height();
 }
 
+inline uint64_t getHash(const std::shared_ptr<BinaryTreeNode>& node) {
+    if (node == nullptr)
+        return 0;
+    else
+        return node->hash();
+}
+
+inline size_t getSize(const std::shared_ptr<BinaryTreeNode>& node) {
+    if (node == nullptr)
+        return 0;
+    else
+        return node->size();
+}
+
 #endif /* BinaryTreeNode_hpp */
\ No newline at end of file
@@ -0,0 +1,382 @@
+// BlockAVLTree.cpp
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "BlockAVLTree.hpp"
+
+namespace {
+	/// blocks with fewer items than this try to merge with a neighbor
+	const int mergeThreshold = BlockTreeNode::capacity / 4;
+
+	/// returns the number of items in the sorted array that are less than item
+	template <typename T>
+	int countLess(const T* items, int itemCount, const T& item) {
+		return static_cast<int>(std::lower_bound(items, items + itemCount, item) - items);
+	}
+
+	/// returns the number of items in the sorted array that are less than item; compares a whole vector of items at a time since a block fits in a few cache lines anyway
+	int countLess(const int* items, int itemCount, const int& item) {
+		int less = 0;
+		int index = 0;
+#if defined(__AVX2__)
+		const __m256i key8 = _mm256_set1_epi32(item);
+		for (; index + 8 <= itemCount; index += 8) {
+			__m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(items + index));
+			int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(key8, values)));
+			less += __builtin_popcount(static_cast<unsigned int>(mask));
+		}
+#endif
+#if defined(__SSE2__)
+		const __m128i key4 = _mm_set1_epi32(item);
+		for (; index + 4 <= itemCount; index += 4) {
+			__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(items + index));
+			int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(values, key4)));
+			less += __builtin_popcount(static_cast<unsigned int>(mask));
+		}
+#endif
+		for (; index < itemCount; index++) {
+			less += items[index] < item;
+		}
+		return less;
+	}
+}
+
+BlockAVLTree::BlockAVLTree() {
+	_root = nullptr;
+	_count = 0;
+	_blockCount = 0;
+}
+
+BlockAVLTree::BlockAVLTree(const BlockAVLTree& source) {
+	_root = _copyNodes(source._root);
+	_count = source._count;
+	_blockCount = source._blockCount;
+}
+
+BlockAVLTree& BlockAVLTree::operator=(const BlockAVLTree& source) {
+	if (this != &source) {
+		clear();
+		_root = _copyNodes(source._root);
+		_count = source._count;
+		_blockCount = source._blockCount;
+	}
+	return *this;
+}
+
+void BlockAVLTree::clear() {
+	_root = nullptr;
+	_count = 0;
+	_blockCount = 0;
+}
+
+void BlockAVLTree::insert(const ItemType& item) {
+	_insertHelp(_root, item);
+}
+
+bool BlockAVLTree::eraseOne(const ItemType& item) {
+	return _eraseHelp(_root, item);
+}
+
+bool BlockAVLTree::contains(const ItemType& item) const {
+	return findBlock(item) != nullptr;
+}
+
+std::shared_ptr<BlockTreeNode> BlockAVLTree::findBlock(const ItemType& item) const {
+	auto block = _findHelp(_root, item);
+	if (!block) {
+		return nullptr;
+	}
+	int index = _lowerBound(*block, item);
+	if (index < block->_itemCount && block->_items[index] == item) {
+		return block;
+	}
+	return nullptr;
+}
+
+std::vector<ItemType> BlockAVLTree::inorder() const {
+	std::vector<ItemType> result;
+	result.reserve(_count);
+	_inorderHelp(_root, result);
+	return result;
+}
+
+int BlockAVLTree::_lowerBound(const BlockTreeNode& node, const ItemType& item) {
+	return countLess(node._items, node._itemCount, item);
+}
+
+std::shared_ptr<BlockTreeNode> BlockAVLTree::_copyNodes(const std::shared_ptr<BlockTreeNode>& rootNode) const {
+	if (!rootNode) {
+		return nullptr;
+	}
+	// copy the block including its items, then recursively copy the left and right subtrees
+	auto newNode = std::make_shared<BlockTreeNode>(*rootNode);
+	newNode->_leftNode = _copyNodes(rootNode->_leftNode);
+	newNode->_rightNode = _copyNodes(rootNode->_rightNode);
+	return newNode;
+}
+
+std::shared_ptr<BlockTreeNode> BlockAVLTree::_findHelp(const std::shared_ptr<BlockTreeNode>& rootNode, const ItemType& item) const {
+	// if the tree is empty, return nullptr
+	if (!rootNode) {
+		return nullptr;
+	}
+	// items below the block's range can only be in the left subtree, items above it only in the right one
+	if (item < rootNode->minimumItem() && rootNode->_leftNode) {
+		return _findHelp(rootNode->_leftNode, item);
+	}
+	if (item > rootNode->maximumItem() && rootNode->_rightNode) {
+		return _findHelp(rootNode->_rightNode, item);
+	}
+	return rootNode;
+}
+
+void BlockAVLTree::_insertHelp(std::shared_ptr<BlockTreeNode>& rootNode, const ItemType& item) {
+	// Base case: if the current node is null, create a new block with the item
+	if (!rootNode) {
+		rootNode = std::make_shared<BlockTreeNode>();
+		rootNode->_items[0] = item;
+		rootNode->_itemCount = 1;
+		_count++;
+		_blockCount++;
+		return;
+	}
+
+	// Recursive case: descend until reaching the block whose range covers item or that borders it without a subtree on that side
+	if (item < rootNode->minimumItem() && rootNode->_leftNode) {
+		_insertHelp(rootNode->_leftNode, item);
+	} else if (item > rootNode->maximumItem() && rootNode->_rightNode) {
+		_insertHelp(rootNode->_rightNode, item);
+	} else {
+		int index = _lowerBound(*rootNode, item);
+		if (index < rootNode->_itemCount && rootNode->_items[index] == item) {
+			// Item already exists in the tree; do not insert duplicates
+			return;
+		}
+		if (rootNode->_itemCount == BlockTreeNode::capacity) {
+			// Full block: move the upper half into a new block that becomes the leftmost block of the right subtree
+			const int half = BlockTreeNode::capacity / 2;
+			auto upper = std::make_shared<BlockTreeNode>();
+			std::copy(rootNode->_items + half, rootNode->_items + BlockTreeNode::capacity, upper->_items);
+			upper->_itemCount = BlockTreeNode::capacity - half;
+			rootNode->_itemCount = half;
+			_blockCount++;
+			if (index > half) {
+				// the item belongs in the upper half
+				index -= half;
+				std::copy_backward(upper->_items + index, upper->_items + upper->_itemCount, upper->_items + upper->_itemCount + 1);
+				upper->_items[index] = item;
+				upper->_itemCount++;
+				_count++;
+				_insertMinimumBlock(rootNode->_rightNode, upper);
+				_rebalance(rootNode);
+				return;
+			}
+			_insertMinimumBlock(rootNode->_rightNode, upper);
+		}
+		std::copy_backward(rootNode->_items + index, rootNode->_items + rootNode->_itemCount, rootNode->_items + rootNode->_itemCount + 1);
+		rootNode->_items[index] = item;
+		rootNode->_itemCount++;
+		_count++;
+	}
+
+	// Update the height of the current node and perform rotations to maintain AVL property
+	_rebalance(rootNode);
+}
+
+void BlockAVLTree::_insertMinimumBlock(std::shared_ptr<BlockTreeNode>& rootNode, const std::shared_ptr<BlockTreeNode>& block) {
+	if (!rootNode) {
+		rootNode = block;
+		return;
+	}
+	_insertMinimumBlock(rootNode->_leftNode, block);
+	_rebalance(rootNode);
+}
+
+bool BlockAVLTree::_eraseHelp(std::shared_ptr<BlockTreeNode>& rootNode, const ItemType& item) {
+	// Base case: item is not in the tree
+	if (!rootNode) {
+		return false;
+	}
+
+	// Recursive case: find the block holding item
+	bool found;
+	if (item < rootNode->minimumItem()) {
+		found = _eraseHelp(rootNode->_leftNode, item);
+	} else if (item > rootNode->maximumItem()) {
+		found = _eraseHelp(rootNode->_rightNode, item);
+	} else {
+		int index = _lowerBound(*rootNode, item);
+		if (index == rootNode->_itemCount || rootNode->_items[index] != item) {
+			return false;
+		}
+		found = true;
+		std::copy(rootNode->_items + index + 1, rootNode->_items + rootNode->_itemCount, rootNode->_items + index);
+		rootNode->_itemCount--;
+		_count--;
+		if (rootNode->_itemCount == 0) {
+			// empty block: remove it from the tree
+			_blockCount--;
+			auto removed = rootNode;
+			if (!removed->_leftNode || !removed->_rightNode) {
+				rootNode = removed->_leftNode ? removed->_leftNode : removed->_rightNode;
+				return true;
+			}
+			auto rightNode = removed->_rightNode;
+			auto successor = _detachMinimum(rightNode);
+			successor->_leftNode = removed->_leftNode;
+			successor->_rightNode = rightNode;
+			rootNode = successor;
+		} else if (rootNode->_itemCount < mergeThreshold) {
+			_mergeNeighbor(rootNode);
+		}
+	}
+	if (!found) {
+		return false;
+	}
+
+	_rebalance(rootNode);
+	return true;
+}
+
+void BlockAVLTree::_mergeNeighbor(const std::shared_ptr<BlockTreeNode>& node) {
+	// the next block is the leftmost block of the right subtree; take its items if they fit
+	if (node->_rightNode) {
+		auto next = node->_rightNode;
+		while (next->_leftNode) {
+			next = next->_leftNode;
+		}
+		if (node->_itemCount + next->_itemCount <= BlockTreeNode::capacity) {
+			auto detached = _detachMinimum(node->_rightNode);
+			std::copy(detached->_items, detached->_items + detached->_itemCount, node->_items + node->_itemCount);
+			node->_itemCount += detached->_itemCount;
+			_blockCount--;
+			return;
+		}
+	}
+	// otherwise the previous block is the rightmost block of the left subtree
+	if (node->_leftNode) {
+		auto previous = node->_leftNode;
+		while (previous->_rightNode) {
+			previous = previous->_rightNode;
+		}
+		if (node->_itemCount + previous->_itemCount <= BlockTreeNode::capacity) {
+			auto detached = _detachMaximum(node->_leftNode);
+			std::copy_backward(node->_items, node->_items + node->_itemCount, node->_items + node->_itemCount + detached->_itemCount);
+			std::copy(detached->_items, detached->_items + detached->_itemCount, node->_items);
+			node->_itemCount += detached->_itemCount;
+			_blockCount--;
+		}
+	}
+}
+
+std::shared_ptr<BlockTreeNode> BlockAVLTree::_detachMinimum(std::shared_ptr<BlockTreeNode>& rootNode) {
+	// the leftmost block has no left child, so its right child takes its place
+	if (!rootNode->_leftNode) {
+		auto minimum = rootNode;
+		rootNode = minimum->_rightNode;
+		minimum->_rightNode = nullptr;
+		return minimum;
+	}
+	auto minimum = _detachMinimum(rootNode->_leftNode);
+	_rebalance(rootNode);
+	return minimum;
+}
+
+std::shared_ptr<BlockTreeNode> BlockAVLTree::_detachMaximum(std::shared_ptr<BlockTreeNode>& rootNode) {
+	// the rightmost block has no right child, so its left child takes its place
+	if (!rootNode->_rightNode) {
+		auto maximum = rootNode;
+		rootNode = maximum->_leftNode;
+		maximum->_leftNode = nullptr;
+		return maximum;
+	}
+	auto maximum = _detachMaximum(rootNode->_rightNode);
+	_rebalance(rootNode);
+	return maximum;
+}
+
+void BlockAVLTree::_rebalance(std::shared_ptr<BlockTreeNode>& node) {
+	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+	int balanceFactor = getHeight(node->_leftNode) - getHeight(node->_rightNode);
+	// Left heavy
+	if (balanceFactor > 1) {
+		if (getHeight(node->_leftNode->_leftNode) >= getHeight(node->_leftNode->_rightNode)) {
+			// Left-Left case
+			_rightSingleRotate(node);
+		} else {
+			// Left-Right case
+			_leftRightRotate(node);
+		}
+	}
+	// Right heavy
+	else if (balanceFactor < -1) {
+		if (getHeight(node->_rightNode->_rightNode) >= getHeight(node->_rightNode->_leftNode)) {
+			// Right-Right case
+			_leftSingleRotate(node);
+		} else {
+			// Right-Left case
+			_rightLeftRotate(node);
+		}
+	}
+}
+
+void BlockAVLTree::_inorderHelp(const std::shared_ptr<BlockTreeNode>& rootNode, std::vector<ItemType>& result) const {
+	if (rootNode) {
+		// traverse left subtree, then the items of the block, then the right subtree
+		_inorderHelp(rootNode->_leftNode, result);
+		result.insert(result.end(), rootNode->_items, rootNode->_items + rootNode->_itemCount);
+		_inorderHelp(rootNode->_rightNode, result);
+	}
+}
+
+void BlockAVLTree::_leftSingleRotate(std::shared_ptr<BlockTreeNode>& node) {
+	// If the node or its right child is null, return
+	if (!node || !node->_rightNode) return;
+	// Store the right child of the node
+	auto right = node->_rightNode;
+	// Update pointers to perform rotation
+	node->_rightNode = right->_leftNode;
+	right->_leftNode = node;
+	// Update heights
+	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+	// Set the new root of the subtree
+	node = right;
+	// Update height of the original node after rotation
+	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+}
+
+void BlockAVLTree::_rightSingleRotate(std::shared_ptr<BlockTreeNode>& node) {
+	// If the node or its left child is null, return
+	if (!node || !node->_leftNode) return;
+	// Store the left child of the node
+	auto left = node->_leftNode;
+	// Update pointers to perform rotation
+	node->_leftNode = left->_rightNode;
+	left->_rightNode = node;
+	// Update heights
+	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+	// Set the new root of the subtree
+	node = left;
+	// Update height of the original node after rotation
+	node->setHeight(1 + std::max(getHeight(node->_leftNode), getHeight(node->_rightNode)));
+}
+
+void BlockAVLTree::_rightLeftRotate(std::shared_ptr<BlockTreeNode>& node) {
+	// If the node or its right child is null, return
+	if (!node || !node->_rightNode) return;
+	// perform right single rotation on the right child
+	_rightSingleRotate(node->_rightNode);
+	_leftSingleRotate(node);
+}
+
+void BlockAVLTree::_leftRightRotate(std::shared_ptr<BlockTreeNode>& node) {
+	// If the node or its left child is null, return
+	if (!node || !node->_leftNode) return;
+	// perform left single rotation on the left child
+	_leftSingleRotate(node->_leftNode);
+	_rightSingleRotate(node);
+}
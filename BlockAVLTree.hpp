@@ -0,0 +1,140 @@
+// BlockAVLTree.hpp
+
+#ifndef BlockAVLTree_hpp
+#define BlockAVLTree_hpp
+
+#include <vector>
+
+#include "BlockTreeNode.hpp"
+
+/// AVL tree of sorted blocks: each node holds up to BlockTreeNode::capacity items, so searches and scans touch one node per block instead of one per item; blocks split when full and merge with a neighbor when they run low, and only blocks are balanced
+class BlockAVLTree {
+
+public:
+    BlockAVLTree();
+
+    // MARK: - methods for dynamic memory classes
+
+    /// copy constructor
+    BlockAVLTree(const BlockAVLTree& source);
+
+    /// assignment operator
+    BlockAVLTree& operator=(const BlockAVLTree& source);
+
+    // MARK: - public methods
+
+    /// returns number of items inserted into the tree
+    size_t count() const { return _count; }
+
+    /// returns number of blocks in the tree
+    size_t blockCount() const { return _blockCount; }
+
+    /// returns height of the tree of blocks; -1 if the tree is empty
+    int height() const { return getHeight(_root); }
+
+    /// removes all elements from the tree
+    void clear();
+
+    /// inserts item into its block, splitting the block if it is full, and maintains AVL balancing property; duplicates are ignored
+    /// - Parameter item: item to insert
+    void insert(const ItemType& item);
+
+    /// removes item from its block, merging the block with a neighbor if it runs low, and maintains AVL balancing property
+    /// - Parameter item: item to remove
+    /// - Returns: true if item was found and removed
+    bool eraseOne(const ItemType& item);
+
+    /// returns true if item is in the tree
+    /// - Parameter item: item to search for
+    bool contains(const ItemType& item) const;
+
+    /// returns the block containing item or nullptr if not in tree
+    /// - Parameter item: item to search for
+    std::shared_ptr<BlockTreeNode> findBlock(const ItemType& item) const;
+
+    /// returns a vector containing the elements of the tree for an inorder traversal
+    std::vector<ItemType> inorder() const;
+
+private:
+    /// returns the position of the first item in the block that is not less than item; uses SIMD compares where available
+    /// - Parameters:
+    ///   - node: block to search
+    ///   - item: item to search for
+    static int _lowerBound(const BlockTreeNode& node, const ItemType& item);
+
+    /// returns a new copy of a tree rooted at rootNode
+    /// - Parameter rootNode: root of subtree to copy
+    std::shared_ptr<BlockTreeNode> _copyNodes(const std::shared_ptr<BlockTreeNode>& rootNode) const;
+
+    /// returns the block that item belongs in or nullptr if the subtree is empty
+    /// - Parameters:
+    ///   - rootNode: root of subtree to search
+    ///   - item: item to search for
+    std::shared_ptr<BlockTreeNode> _findHelp(const std::shared_ptr<BlockTreeNode>& rootNode, const ItemType& item) const;
+
+    /// insert item in tree rooted at rootNode
+    /// - Parameters:
+    ///   - rootNode: rootNode of tree to insert in which is passed by reference since rotation may change it
+    ///   - item: item to insert
+    void _insertHelp(std::shared_ptr<BlockTreeNode>& rootNode, const ItemType& item);
+
+    /// inserts block as the new leftmost block of the tree rooted at rootNode
+    /// - Parameters:
+    ///   - rootNode: rootNode of tree to insert in which is passed by reference since rotation may change it
+    ///   - block: block whose items are all less than those of the tree
+    void _insertMinimumBlock(std::shared_ptr<BlockTreeNode>& rootNode, const std::shared_ptr<BlockTreeNode>& block);
+
+    /// remove item from tree rooted at rootNode
+    /// - Parameters:
+    ///   - rootNode: rootNode of tree to remove from which is passed by reference since removal and rotation may change it
+    ///   - item: item to remove
+    /// - Returns: true if item was found
+    bool _eraseHelp(std::shared_ptr<BlockTreeNode>& rootNode, const ItemType& item);
+
+    /// merges a block that runs low with the next block of its right subtree, or failing that the previous block of its left subtree, if their items fit into one block
+    /// - Parameter node: block to merge into
+    void _mergeNeighbor(const std::shared_ptr<BlockTreeNode>& node);
+
+    /// unlinks the leftmost block from the tree rooted at rootNode, rebalancing on the way up, and returns it
+    /// - Parameter rootNode: rootNode of non-empty tree which is passed by reference since removal and rotation may change it
+    std::shared_ptr<BlockTreeNode> _detachMinimum(std::shared_ptr<BlockTreeNode>& rootNode);
+
+    /// unlinks the rightmost block from the tree rooted at rootNode, rebalancing on the way up, and returns it
+    /// - Parameter rootNode: rootNode of non-empty tree which is passed by reference since removal and rotation may change it
+    std::shared_ptr<BlockTreeNode> _detachMaximum(std::shared_ptr<BlockTreeNode>& rootNode);
+
+    /// updates the height of node and restores the AVL property at it
+    /// - Parameter node: node to rebalance which is passed by reference since rotation may change it
+    void _rebalance(std::shared_ptr<BlockTreeNode>& node);
+
+    /// inorder traversal helper
+    /// - Parameters:
+    ///   - rootNode: root of subtree to run traversal on
+    ///   - result: vector to append the items to
+    void _inorderHelp(const std::shared_ptr<BlockTreeNode>& rootNode, std::vector<ItemType>& result) const;
+
+    /// rotation helper
+    /// - Parameter node: node to perform rotation at
+    void _leftSingleRotate(std::shared_ptr<BlockTreeNode>& node);
+
+    /// rotation helper
+    /// - Parameter node: node to perform rotation at
+    void _rightSingleRotate(std::shared_ptr<BlockTreeNode>& node);
+
+    /// rotation helper
+    /// - Parameter node: node to perform rotation at
+    void _rightLeftRotate(std::shared_ptr<BlockTreeNode>& node);
+
+    /// rotation helper
+    /// - Parameter node: node to perform rotation at
+    void _leftRightRotate(std::shared_ptr<BlockTreeNode>& node);
+
+    /// pointer to root block of tree
+    std::shared_ptr<BlockTreeNode> _root;
+    /// number of items in the tree
+    size_t _count;
+    /// number of blocks in the tree
+    size_t _blockCount;
+};
+
+#endif /* BlockAVLTree_hpp */
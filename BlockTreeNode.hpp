@@ -0,0 +1,53 @@
+// BlockTreeNode.hpp
+
+#ifndef BlockTreeNode_hpp
+#define BlockTreeNode_hpp
+
+#include <cstddef>
+#include <memory>
+
+#include "BinaryTreeNode.hpp"
+
+/// node of a BlockAVLTree holding a small sorted array of items instead of a single item
+class BlockTreeNode {
+    friend class BlockAVLTree;
+
+public:
+    /// maximum number of items in a block
+    static const int capacity = 32;
+
+    BlockTreeNode();
+
+    int height() const { return _height; }
+    void setHeight(const int height) { _height = height; }
+    /// returns number of items in the block
+    int itemCount() const { return _itemCount; }
+    /// returns the item at the specified position of the block
+    ItemType item(const int index) const { return _items[index]; }
+    ItemType minimumItem() const { return _items[0]; }
+    ItemType maximumItem() const { return _items[_itemCount - 1]; }
+
+private:
+    /// items of the block in ascending order
+    alignas(16) ItemType _items[capacity];
+    int _itemCount;
+    std::shared_ptr<BlockTreeNode> _leftNode;
+    std::shared_ptr<BlockTreeNode> _rightNode;
+    int _height;
+};
+
+inline BlockTreeNode::BlockTreeNode() {
+    _itemCount = 0;
+    _leftNode = nullptr;
+    _rightNode = nullptr;
+    _height = 0;
+}
+
+inline int getHeight(const std::shared_ptr<BlockTreeNode>& node) {
+    if (node == nullptr)
+        return -1;
+    else
+        return node->height();
+}
+
+#endif /* BlockTreeNode_hpp */
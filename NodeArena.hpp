@@ -0,0 +1,169 @@
+// NodeArena.hpp
+
+#ifndef NodeArena_hpp
+#define NodeArena_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+/// contiguous block of equally sized slots that are handed out in sequence; the block is released once the arena is no longer referenced by any allocator
+class NodeArena {
+
+public:
+    /// creates an arena with room for capacity allocations; the block itself is allocated on the first request, once the slot size is known
+    /// - Parameter capacity: number of slots
+    explicit NodeArena(size_t capacity);
+
+    ~NodeArena() { ::operator delete(_block); }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    /// returns the next free slot or nullptr if the arena is full or bytes does not match the slot size
+    /// - Parameter bytes: size of the requested allocation
+    void* allocate(size_t bytes);
+
+    /// marks a slot previously returned by allocate as no longer in use; slots are not reused
+    void deallocate(void*) { _live--; }
+
+    /// returns true if pointer lies inside the arena's block
+    /// - Parameter pointer: address to check
+    bool owns(const void* pointer) const;
+
+    /// returns size in bytes of each slot
+    size_t slotSize() const { return _slotSize; }
+
+    /// returns number of slots
+    size_t capacity() const { return _capacity; }
+
+    /// returns number of slots currently holding an allocation
+    size_t live() const { return _live; }
+
+private:
+    /// block the slots are carved from
+    char* _block;
+    /// size in bytes of each slot
+    size_t _slotSize;
+    /// number of slots
+    size_t _capacity;
+    /// number of slots handed out so far
+    size_t _used;
+    /// number of slots handed out and not yet deallocated; may be decremented from any thread
+    std::atomic<size_t> _live;
+};
+
+inline NodeArena::NodeArena(size_t capacity) {
+    _block = nullptr;
+    _slotSize = 0;
+    _capacity = capacity;
+    _used = 0;
+    _live = 0;
+}
+
+inline void* NodeArena::allocate(size_t bytes) {
+    if (!_block) {
+        _block = static_cast<char*>(::operator new(bytes * _capacity));
+        _slotSize = bytes;
+    }
+    if (bytes != _slotSize || _used == _capacity)
+        return nullptr;
+    _live++;
+    return _block + _slotSize * _used++;
+}
+
+inline bool NodeArena::owns(const void* pointer) const {
+    const char* address = static_cast<const char*>(pointer);
+    return _block && address >= _block && address < _block + _slotSize * _capacity;
+}
+
+/// allocator for std::allocate_shared that places single allocations in a NodeArena and falls back to the heap
+template <typename T>
+class NodeAllocator {
+
+public:
+    typedef T value_type;
+
+    explicit NodeAllocator(const std::shared_ptr<NodeArena>& arena = nullptr) : _arena(arena) {}
+
+    template <typename U>
+    NodeAllocator(const NodeAllocator<U>& other) : _arena(other._arena) {}
+
+    T* allocate(size_t n) {
+        if (_arena && n == 1) {
+            void* slot = _arena->allocate(sizeof(T));
+            if (slot)
+                return static_cast<T*>(slot);
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, size_t) {
+        if (_arena && _arena->owns(pointer))
+            _arena->deallocate(pointer);
+        else
+            ::operator delete(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const NodeAllocator<U>& other) const { return _arena == other._arena; }
+
+    template <typename U>
+    bool operator!=(const NodeAllocator<U>& other) const { return _arena != other._arena; }
+
+private:
+    template <typename U> friend class NodeAllocator;
+
+    /// arena to allocate from; nullptr allocates everything on the heap
+    std::shared_ptr<NodeArena> _arena;
+};
+
+/// returns the size of the most recent allocation made by an AllocationSizeProbe on this thread
+inline size_t& probedAllocationSize() {
+    thread_local size_t bytes = 0;
+    return bytes;
+}
+
+/// stateless allocator that only records the size of the allocation std::allocate_shared makes; being stateless keeps the control block the same size as with std::make_shared
+template <typename T>
+class AllocationSizeProbe {
+
+public:
+    typedef T value_type;
+
+    AllocationSizeProbe() {}
+
+    template <typename U>
+    AllocationSizeProbe(const AllocationSizeProbe<U>&) {}
+
+    T* allocate(size_t n) {
+        probedAllocationSize() = n * sizeof(T);
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, size_t) { ::operator delete(pointer); }
+
+    template <typename U>
+    bool operator==(const AllocationSizeProbe<U>&) const { return true; }
+
+    template <typename U>
+    bool operator!=(const AllocationSizeProbe<U>&) const { return false; }
+};
+
+/// returns the number of bytes std::make_shared allocates for a T, i.e. the object together with its shared_ptr control block
+template <typename T, typename... Args>
+size_t sharedAllocationSize(Args&&... args) {
+    std::allocate_shared<T>(AllocationSizeProbe<T>(), std::forward<Args>(args)...);
+    return probedAllocationSize();
+}
+
+/// returns the number of bytes a general purpose malloc really reserves for a request of the specified size; models the common 16-byte aligned chunks with an 8-byte header and a 32-byte minimum
+/// - Parameter bytes: requested size
+inline size_t mallocChunkSize(size_t bytes) {
+    size_t chunk = (bytes + sizeof(size_t) + 15) & ~static_cast<size_t>(15);
+    return chunk < 32 ? 32 : chunk;
+}
+
+#endif /* NodeArena_hpp */
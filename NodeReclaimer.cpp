@@ -0,0 +1,103 @@
+// NodeReclaimer.cpp
+
+#include <limits>
+
+#include "NodeReclaimer.hpp"
+
+namespace {
+	/// number of nodes the background thread frees between checks for new work and shutdown
+	const size_t backgroundChunkNodes = 4096;
+}
+
+NodeReclaimer::NodeReclaimer(Mode mode, size_t maxPendingNodes, size_t stepNodes)
+	: _mode(mode), _maxPendingNodes(maxPendingNodes), _stepNodes(stepNodes > 0 ? stepNodes : 1) {
+	_pendingNodes = 0;
+	_stopping = false;
+	if (_mode == Background) {
+		_worker = std::thread(&NodeReclaimer::_backgroundLoop, this);
+	}
+}
+
+NodeReclaimer::~NodeReclaimer() {
+	if (_worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_wake.notify_one();
+		_worker.join();
+	}
+	drain();
+}
+
+void NodeReclaimer::retire(std::shared_ptr<BinaryTreeNode> root, size_t nodeCount) {
+	if (!root) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pending.push_back(std::move(root));
+	}
+	size_t pending = _pendingNodes += nodeCount;
+	if (_mode == Background) {
+		_wake.notify_one();
+	}
+	// only the part above the cap is freed here, never the whole backlog
+	while (pending > _maxPendingNodes) {
+		if (reclaim(pending - _maxPendingNodes) == 0) {
+			break;
+		}
+		pending = _pendingNodes;
+	}
+}
+
+size_t NodeReclaimer::reclaim(size_t maxNodes) {
+	std::vector<std::shared_ptr<BinaryTreeNode>> work;
+	size_t freed = 0;
+	while (freed < maxNodes) {
+		if (work.empty()) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_pending.empty()) {
+				break;
+			}
+			work.push_back(std::move(_pending.back()));
+			_pending.pop_back();
+		}
+		std::shared_ptr<BinaryTreeNode> node = std::move(work.back());
+		work.pop_back();
+		// the children are referenced, not moved out, so releasing the node frees only the node itself and never changes a node a caller can still reach through a parent link
+		if (node->_leftNode)
+			work.push_back(node->_leftNode);
+		if (node->_rightNode)
+			work.push_back(node->_rightNode);
+		node.reset();
+		freed++;
+		_pendingNodes--;
+	}
+	if (!work.empty()) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto& node : work) {
+			_pending.push_back(std::move(node));
+		}
+	}
+	return freed;
+}
+
+void NodeReclaimer::drain() {
+	while (reclaim(std::numeric_limits<size_t>::max()) > 0) {
+	}
+}
+
+void NodeReclaimer::_backgroundLoop() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true) {
+		_wake.wait(lock, [this]() { return _stopping || !_pending.empty(); });
+		if (_stopping) {
+			return;
+		}
+		lock.unlock();
+		while (reclaim(backgroundChunkNodes) > 0) {
+		}
+		lock.lock();
+	}
+}
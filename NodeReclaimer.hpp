@@ -0,0 +1,93 @@
+// NodeReclaimer.hpp
+
+#ifndef NodeReclaimer_hpp
+#define NodeReclaimer_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BinaryTreeNode.hpp"
+
+/// frees the nodes of detached subtrees in bounded steps instead of in one cascade of shared_ptr destructors; work is counted in nodes, tombstones included
+class NodeReclaimer {
+
+public:
+    enum Mode {
+        /// nodes are freed in small steps by the trees using the reclaimer as they are modified, or by calling reclaim
+        Incremental,
+        /// nodes are freed by a background thread owned by the reclaimer
+        Background
+    };
+
+    /// creates a reclaimer
+    /// - Parameters:
+    ///   - mode: who frees the nodes
+    ///   - maxPendingNodes: bound on the number of nodes awaiting reclamation; a retire that exceeds it frees the excess on the calling thread
+    ///   - stepNodes: number of nodes freed by one step of an incremental reclaimer
+    explicit NodeReclaimer(Mode mode, size_t maxPendingNodes = static_cast<size_t>(1) << 24, size_t stepNodes = 256);
+
+    /// frees all pending nodes, after stopping the background thread if there is one
+    ~NodeReclaimer();
+
+    NodeReclaimer(const NodeReclaimer&) = delete;
+    NodeReclaimer& operator=(const NodeReclaimer&) = delete;
+
+    /// returns who frees the nodes
+    Mode mode() const { return _mode; }
+
+    /// returns the bound on the number of nodes awaiting reclamation
+    size_t maxPendingNodes() const { return _maxPendingNodes; }
+
+    /// returns the number of nodes awaiting reclamation
+    size_t pendingNodes() const { return _pendingNodes; }
+
+    /// takes over a detached subtree in O(1); only if the pending nodes then exceed the cap does the caller free the excess
+    /// - Parameters:
+    ///   - root: root of the subtree; the caller must not hold other references to its nodes
+    ///   - nodeCount: number of nodes of the subtree, which the reclaimer cannot find out in O(1)
+    void retire(std::shared_ptr<BinaryTreeNode> root, size_t nodeCount);
+
+    /// frees the nodes of one step if the reclaimer is incremental and has pending nodes; called by trees as they are modified
+    void step() {
+        if (_mode == Incremental && _pendingNodes > 0)
+            reclaim(_stepNodes);
+    }
+
+    /// frees pending nodes on the calling thread until maxNodes nodes are gone
+    /// - Parameter maxNodes: number of nodes to free; a node still referenced elsewhere counts as freed, and its children are visited like any other node
+    /// - Returns: number of nodes freed; 0 if nothing was pending
+    size_t reclaim(size_t maxNodes);
+
+    /// frees all pending nodes on the calling thread
+    void drain();
+
+private:
+    /// frees pending nodes in background mode until the reclaimer is destroyed
+    void _backgroundLoop();
+
+    /// who frees the nodes
+    const Mode _mode;
+    /// bound on the number of nodes awaiting reclamation
+    const size_t _maxPendingNodes;
+    /// number of nodes freed by one incremental step
+    const size_t _stepNodes;
+    /// roots of the subtrees awaiting reclamation
+    std::vector<std::shared_ptr<BinaryTreeNode>> _pending;
+    /// number of nodes of the pending subtrees
+    std::atomic<size_t> _pendingNodes;
+    /// guards _pending and _stopping
+    std::mutex _mutex;
+    /// signalled when subtrees are retired or the reclaimer is destroyed
+    std::condition_variable _wake;
+    /// set when the background thread should finish
+    bool _stopping;
+    /// thread freeing the nodes in background mode
+    std::thread _worker;
+};
+
+#endif /* NodeReclaimer_hpp */
@@ -0,0 +1,130 @@
+// StaticAVLTree.hpp
+
+#ifndef StaticAVLTree_hpp
+#define StaticAVLTree_hpp
+
+#include <cstddef>
+
+#include "BinaryTreeNode.hpp"
+
+/// immutable balanced search tree over a key set known at compile time, so a constexpr instance lives in read-only data; the tree is implicit, a node being a pointer into the sorted items
+template <size_t N>
+class StaticAVLTree {
+    static_assert(N > 0, "a StaticAVLTree needs at least one item");
+
+public:
+    /// builds the tree from items in any order; duplicates are stored once
+    /// - Parameter items: items of the tree
+    constexpr explicit StaticAVLTree(const ItemType (&items)[N]);
+
+    /// returns number of distinct items in the tree
+    constexpr size_t count() const { return _count; }
+
+    /// returns the height of the tree
+    constexpr int height() const;
+
+    /// returns node containing item or nullptr if not in tree
+    /// - Parameter item: item to search for
+    constexpr const ItemType* find(const ItemType& item) const;
+
+    /// returns true if item is in the tree
+    /// - Parameter item: item to search for
+    constexpr bool contains(const ItemType& item) const { return find(item) != nullptr; }
+
+    /// returns node containing the minimum element
+    constexpr const ItemType* minimumNode() const { return _items; }
+
+    /// returns node containing the maximum element
+    constexpr const ItemType* maximumNode() const { return _items + _count - 1; }
+
+    /// returns the node containing the next smallest item in the tree than the item at the specified node; returns nullptr if node is nullptr or is the node with the minimum value in the tree
+    /// - Parameter node: node whose item to use to find next smallest item
+    constexpr const ItemType* nextSmallestNode(const ItemType* node) const { return node && node != _items ? node - 1 : nullptr; }
+
+    /// returns the node containing the next largest item in the tree than the item at the specified node; returns nullptr if node is nullptr or is the node with the maximum value in the tree
+    /// - Parameter node: node whose item to use to find next largest item
+    constexpr const ItemType* nextLargestNode(const ItemType* node) const { return node && node != maximumNode() ? node + 1 : nullptr; }
+
+    /// returns a pointer to the minimum item; the items up to end() are in inorder sequence
+    constexpr const ItemType* begin() const { return _items; }
+
+    /// returns the pointer past the maximum item
+    constexpr const ItemType* end() const { return _items + _count; }
+
+private:
+    /// narrows a lower bound search from Length slots starting at base down to one slot; the number of steps only depends on N, so the recursion unrolls into a fixed sequence of conditional moves
+    /// - Parameters:
+    ///   - base: first slot that may hold the lower bound
+    ///   - item: item to search for
+    template <size_t Length>
+    static constexpr const ItemType* _lowerBoundStep(const ItemType* base, const ItemType& item);
+
+    /// distinct items in ascending order, followed by copies of the maximum item up to N so searches can run over all N slots
+    ItemType _items[N];
+    /// number of distinct items
+    size_t _count;
+};
+
+/// returns a StaticAVLTree of items, deducing N; use as constexpr auto table = makeStaticAVLTree({ 3, 1, 2 });
+/// - Parameter items: items of the tree
+template <size_t N>
+constexpr StaticAVLTree<N> makeStaticAVLTree(const ItemType (&items)[N]) {
+    return StaticAVLTree<N>(items);
+}
+
+template <size_t N>
+constexpr StaticAVLTree<N>::StaticAVLTree(const ItemType (&items)[N]) : _items(), _count(0) {
+    // insertion sort, which is constexpr and fast enough for tables written out in source
+    for (size_t i = 0; i < N; i++) {
+        ItemType item = items[i];
+        size_t position = i;
+        while (position > 0 && item < _items[position - 1]) {
+            _items[position] = _items[position - 1];
+            position--;
+        }
+        _items[position] = item;
+    }
+    // drop duplicates, then pad with the maximum
+    _count = 1;
+    for (size_t i = 1; i < N; i++) {
+        if (_items[_count - 1] < _items[i]) {
+            _items[_count++] = _items[i];
+        }
+    }
+    const ItemType maximum = _items[_count - 1];
+    for (size_t i = _count; i < N; i++) {
+        _items[i] = maximum;
+    }
+}
+
+template <size_t N>
+constexpr int StaticAVLTree<N>::height() const {
+    // a subtree of k nodes rooted at its middle item has height floor(log2(k))
+    int height = -1;
+    for (size_t nodes = _count; nodes > 0; nodes /= 2) {
+        height++;
+    }
+    return height;
+}
+
+template <size_t N>
+template <size_t Length>
+constexpr const ItemType* StaticAVLTree<N>::_lowerBoundStep(const ItemType* base, const ItemType& item) {
+    if constexpr (Length <= 1) {
+        return base;
+    } else {
+        constexpr size_t half = Length / 2;
+        return _lowerBoundStep<Length - half>(base[half] < item ? base + half : base, item);
+    }
+}
+
+template <size_t N>
+constexpr const ItemType* StaticAVLTree<N>::find(const ItemType& item) const {
+    const ItemType* base = _lowerBoundStep<N>(_items, item);
+    if (*base < item) {
+        base++;
+    }
+    return base < _items + _count && *base == item ? base : nullptr;
+}
+
+#endif /* StaticAVLTree_hpp */
@@ -0,0 +1,81 @@
+// TraceRecorder.cpp
+
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <ostream>
+
+#include "TraceRecorder.hpp"
+
+namespace {
+	/// bytes every trace starts with
+	const char traceMagic[4] = { 'A', 'V', 'L', 'T' };
+	/// version of the trace format written by TraceRecorder
+	const uint8_t traceVersion = 1;
+}
+
+const char* traceKindName(TraceEvent::Kind kind) {
+	static const char* const names[TraceEvent::KindCount] = {
+		"insert", "erase", "find", "nextLargest", "nextSmallest", "minimum", "maximum",
+		"inorder", "preorder", "postorder", "forEach", "clear", "markDeleted"
+	};
+	return kind < TraceEvent::KindCount ? names[kind] : "unknown";
+}
+
+TraceRecorder::TraceRecorder(std::ostream& out, size_t bufferBytes) : _out(out) {
+	_bufferBytes = bufferBytes > 0 ? bufferBytes : 1;
+	// room for the largest record, so record never reallocates before the buffer is written out
+	_buffer.reserve(_bufferBytes + 11);
+	for (char byte : traceMagic)
+		_buffer.push_back(static_cast<uint8_t>(byte));
+	_buffer.push_back(traceVersion);
+	_previousItem = 0;
+	_eventCount = 0;
+}
+
+TraceRecorder::~TraceRecorder() {
+	flush();
+}
+
+void TraceRecorder::flush() {
+	if (!_buffer.empty()) {
+		_out.write(reinterpret_cast<const char*>(_buffer.data()), static_cast<std::streamsize>(_buffer.size()));
+		_buffer.clear();
+	}
+	_out.flush();
+}
+
+bool readTrace(std::istream& in, std::vector<TraceEvent>& events) {
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (bytes.size() < sizeof(traceMagic) + 1 || std::memcmp(bytes.data(), traceMagic, sizeof(traceMagic)) != 0 || bytes[sizeof(traceMagic)] != traceVersion) {
+		return false;
+	}
+	uint64_t previousItem = 0;
+	size_t position = sizeof(traceMagic) + 1;
+	while (position < bytes.size()) {
+		uint8_t kind = bytes[position++];
+		if (kind >= TraceEvent::KindCount) {
+			return false;
+		}
+		TraceEvent event = { static_cast<TraceEvent::Kind>(kind), ItemType() };
+		if (traceKindHasItem(event.kind)) {
+			uint64_t zigzag = 0;
+			bool complete = false;
+			for (int shift = 0; shift < 64 && position < bytes.size(); shift += 7) {
+				uint8_t byte = bytes[position++];
+				zigzag |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if (!(byte & 0x80)) {
+					complete = true;
+					break;
+				}
+			}
+			if (!complete) {
+				return false;
+			}
+			previousItem += (zigzag >> 1) ^ (0 - (zigzag & 1));
+			event.item = static_cast<ItemType>(static_cast<int64_t>(previousItem));
+		}
+		events.push_back(event);
+	}
+	return true;
+}
@@ -0,0 +1,116 @@
+// TraceRecorder.hpp
+
+#ifndef TraceRecorder_hpp
+#define TraceRecorder_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+#include "BinaryTreeNode.hpp"
+
+// Trace format: the 4 bytes "AVLT" and a version byte, followed by one record per operation. A record is the
+// operation's kind as one byte and, for operations on an item, the difference to the item of the previous such
+// record as a zigzag-encoded base-128 varint, so runs of nearby items take one or two bytes each.
+
+// Operations without an event of their own are recorded as the ones they amount to: inorder and exportInorder as an
+// Inorder traversal, forEach and mapReduce as a ForEach, applyBatch as its individual operations, applyDelta as an
+// Erase of every item it removes and an Insert of every item it adds or gives a new multiplicity, assignment as a Clear.
+
+/// single operation on a tree, as recorded by TraceRecorder and read back by readTrace
+struct TraceEvent {
+    enum Kind { Insert, Erase, Find, NextLargest, NextSmallest, Minimum, Maximum, Inorder, Preorder, Postorder, ForEach, Clear, MarkDeleted, KindCount };
+
+    Kind kind;
+    /// item the operation was called with; for NextLargest and NextSmallest the item of the node passed in; 0 for operations without an item
+    ItemType item;
+};
+
+/// returns true if events of the specified kind carry an item
+/// - Parameter kind: kind of event
+inline bool traceKindHasItem(TraceEvent::Kind kind) {
+    return kind <= TraceEvent::NextSmallest || kind == TraceEvent::MarkDeleted;
+}
+
+/// returns a short lowercase name of kind, such as "insert"
+/// - Parameter kind: kind of event
+const char* traceKindName(TraceEvent::Kind kind);
+
+/// appends the operations of a tree to a stream in the compact trace format; records are collected in a buffer that is written out whenever it fills, so recording an operation costs a few byte stores; not thread-safe
+class TraceRecorder {
+
+public:
+    /// creates a recorder that writes the trace header and then the recorded operations to out
+    /// - Parameters:
+    ///   - out: binary stream to write to; must outlive the recorder
+    ///   - bufferBytes: number of bytes collected before they are written to out
+    explicit TraceRecorder(std::ostream& out, size_t bufferBytes = 1 << 16);
+
+    /// writes out the records still in the buffer
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    /// records an operation without an item
+    /// - Parameter kind: kind of operation
+    void record(TraceEvent::Kind kind);
+
+    /// records an operation on an item
+    /// - Parameters:
+    ///   - kind: kind of operation
+    ///   - item: item the operation was called with
+    void record(TraceEvent::Kind kind, const ItemType& item);
+
+    /// writes the records in the buffer to the stream and flushes it
+    void flush();
+
+    /// returns number of operations recorded
+    size_t eventCount() const { return _eventCount; }
+
+private:
+    /// stream the trace is written to
+    std::ostream& _out;
+    /// records not yet written to the stream
+    std::vector<uint8_t> _buffer;
+    /// buffer size at which it is written out
+    size_t _bufferBytes;
+    /// item of the last record with an item, which the next one is encoded relative to
+    uint64_t _previousItem;
+    /// number of operations recorded
+    size_t _eventCount;
+};
+
+/// reads a whole trace
+/// - Parameters:
+///   - in: binary stream positioned at the start of a trace
+///   - events: vector the events are appended to
+/// - Returns: false if the stream does not hold a trace or ends in the middle of a record; events read before the error are kept
+bool readTrace(std::istream& in, std::vector<TraceEvent>& events);
+
+inline void TraceRecorder::record(TraceEvent::Kind kind) {
+    _buffer.push_back(static_cast<uint8_t>(kind));
+    _eventCount++;
+    if (_buffer.size() >= _bufferBytes)
+        flush();
+}
+
+inline void TraceRecorder::record(TraceEvent::Kind kind, const ItemType& item) {
+    _buffer.push_back(static_cast<uint8_t>(kind));
+    // wrap-around difference, zigzag encoded so small steps in either direction stay small
+    uint64_t value = static_cast<uint64_t>(static_cast<int64_t>(item));
+    uint64_t delta = value - _previousItem;
+    uint64_t zigzag = (delta << 1) ^ (0 - (delta >> 63));
+    _previousItem = value;
+    while (zigzag >= 0x80) {
+        _buffer.push_back(static_cast<uint8_t>(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    _buffer.push_back(static_cast<uint8_t>(zigzag));
+    _eventCount++;
+    if (_buffer.size() >= _bufferBytes)
+        flush();
+}
+
+#endif /* TraceRecorder_hpp */
@@ -0,0 +1,87 @@
+// benchmark.cpp — compares the balancing policies on insert, churn and lookup workloads
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "AVLTree.hpp"
+
+struct PhaseResult {
+    std::string phase;
+    size_t operations;
+    double seconds;
+    size_t rotations;
+    int height;
+};
+
+template <typename Tree>
+static std::vector<PhaseResult> run_policy(const std::vector<ItemType>& keys, size_t churnSteps, unsigned int seed) {
+    std::vector<PhaseResult> results;
+    Tree t;
+    std::mt19937 rng(seed);
+    auto timed = [&](const std::string& phase, size_t operations, auto&& body) {
+        size_t rotationsBefore = t.rotationCount();
+        auto start = std::chrono::steady_clock::now();
+        body();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        results.push_back({ phase, operations, elapsed.count(), t.rotationCount() - rotationsBefore, t.height() });
+    };
+
+    timed("insert", keys.size(), [&]() {
+        for (auto key : keys) t.insert(key);
+    });
+    // write-heavy churn: every step removes one present key and inserts a new one
+    timed("churn", 2 * churnSteps, [&]() {
+        std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+        ItemType next = static_cast<ItemType>(keys.size());
+        std::vector<ItemType> live(keys);
+        for (size_t step = 0; step < churnSteps; ++step) {
+            size_t index = pick(rng);
+            t.eraseOne(live[index]);
+            live[index] = next++;
+            t.insert(live[index]);
+        }
+    });
+    size_t found = 0;
+    timed("find", keys.size(), [&]() {
+        for (auto key : keys) found += t.find(key) != nullptr;
+    });
+    if (found > keys.size()) std::cerr << "unexpected find result\n";
+    timed("erase", t.count(), [&]() {
+        for (auto key : t.inorder()) t.eraseOne(key);
+    });
+    return results;
+}
+
+static void print_results(const std::string& policy, const std::vector<PhaseResult>& results) {
+    for (const auto& r : results) {
+        std::cout << std::left << std::setw(10) << policy << std::setw(8) << r.phase
+            << std::right << std::setw(12) << r.operations
+            << std::setw(12) << std::fixed << std::setprecision(2) << (r.operations / r.seconds / 1e6)
+            << std::setw(12) << r.rotations
+            << std::setw(8) << r.height << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? static_cast<size_t>(std::strtoull(argv[1], nullptr, 10)) : 1000000;
+    size_t churn = argc > 2 ? static_cast<size_t>(std::strtoull(argv[2], nullptr, 10)) : n;
+    if (n == 0) {
+        std::cerr << "usage: " << argv[0] << " [items] [churn steps]\n";
+        return 1;
+    }
+    std::vector<ItemType> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = static_cast<ItemType>(i);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+
+    std::cout << "Balancing policy benchmark: " << n << " items, " << churn << " churn steps\n";
+    std::cout << std::left << std::setw(10) << "policy" << std::setw(8) << "phase"
+        << std::right << std::setw(12) << "ops" << std::setw(12) << "Mops/s"
+        << std::setw(12) << "rotations" << std::setw(8) << "height" << "\n";
+    print_results("AVL", run_policy<AVLTree>(keys, churn, 7));
+    print_results("WAVL", run_policy<WAVLTree>(keys, churn, 7));
+    return 0;
+}
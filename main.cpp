@@ -7,8 +7,16 @@
 #include <iomanip>
 #include <exception>
 #include <limits>   // INT_MIN / INT_MAX
+#include <atomic>
+#include <cmath>
 #include <type_traits>
+#include <set>
+#include <chrono>
+#include <thread>
+#include <sstream>
 #include "AVLTree.hpp"
+#include "BlockAVLTree.hpp"
+#include "StaticAVLTree.hpp"
 
 // ---------- tiny test harness ----------
 #define EXPECT_TRUE(cond)  do { if (!(cond)) { \
@@ -399,6 +407,1057 @@ static void test_duplicates_observation() {
     }
 }
 
+static void test_parallel_export_and_map_reduce() {
+    std::cout << "\n== test_parallel_export_and_map_reduce ==\n";
+    AVLTree t;
+    const int N = 100000; // large enough to be split across worker threads
+    for (int i = 0; i < N; ++i) t.insert(static_cast<ItemType>((i * 7919) % N));
+    EXPECT_EQ(t.count(), static_cast<size_t>(N));
+
+    std::vector<ItemType> want(N);
+    for (int i = 0; i < N; ++i) want[i] = static_cast<ItemType>(i);
+
+    std::vector<ItemType> out(t.count());
+    t.exportInorder(out.data());
+    EXPECT_VEC_EQ(out, want, "exportInorder");
+    EXPECT_VEC_EQ(t.inorder(), want, "inorder via exportInorder");
+
+    std::atomic<long long> sum(0);
+    std::atomic<size_t> visited(0);
+    t.forEach([&](const ItemType& x) { sum += x; visited++; });
+    EXPECT_EQ(visited.load(), static_cast<size_t>(N));
+    EXPECT_EQ(sum.load(), static_cast<long long>(N) * (N - 1) / 2);
+
+    long long reduced = t.mapReduce([](const ItemType& x) { return static_cast<long long>(x); },
+        [](long long a, long long b) { return a + b; }, 0LL);
+    EXPECT_EQ(reduced, static_cast<long long>(N) * (N - 1) / 2);
+
+    // reduce is applied in inorder sequence, so concatenation reproduces the sorted items
+    auto concatenated = t.mapReduce([](const ItemType& x) { return std::vector<ItemType>{ x }; },
+        [](std::vector<ItemType> a, const std::vector<ItemType>& b) { a.insert(a.end(), b.begin(), b.end()); return a; },
+        std::vector<ItemType>());
+    EXPECT_VEC_EQ(concatenated, want, "mapReduce concatenation");
+
+    AVLTree empty;
+    EXPECT_EQ(empty.mapReduce([](const ItemType& x) { return x; },
+        [](ItemType a, ItemType b) { return a + b; }, 0), 0);
+}
+
+static void test_memory_usage_and_shrink_to_fit() {
+    std::cout << "\n== test_memory_usage_and_shrink_to_fit ==\n";
+    AVLTree t;
+    MemoryUsage none = t.memoryUsage();
+    EXPECT_EQ(none.totalBytes(), static_cast<size_t>(0));
+
+    const int N = 1000;
+    for (int i = 0; i < N; ++i) t.insert(static_cast<ItemType>((i * 37) % N));
+    MemoryUsage before = t.memoryUsage();
+    EXPECT_EQ(before.nodeBytes, N * sizeof(BinaryTreeNode));
+    EXPECT_TRUE(before.controlBlockBytes > 0);
+    EXPECT_TRUE(before.allocatorSlackBytes > 0);
+
+    auto want = t.inorder();
+    t.shrinkToFit();
+    EXPECT_VEC_EQ(t.inorder(), want, "inorder after shrinkToFit");
+    EXPECT_EQ(t.count(), static_cast<size_t>(N));
+    MemoryUsage after = t.memoryUsage();
+    EXPECT_EQ(after.nodeBytes, before.nodeBytes);
+    EXPECT_TRUE(after.allocatorSlackBytes < before.allocatorSlackBytes);
+
+    // nodes are laid out in inorder sequence and parent links still work
+    auto node = t.minimumNode();
+    int steps = 1;
+    for (auto next = t.nextLargestNode(node); next != nullptr; next = t.nextLargestNode(next)) {
+        EXPECT_TRUE(next.get() > node.get());
+        node = next;
+        ++steps;
+    }
+    EXPECT_EQ(steps, N);
+
+    // the tree keeps working after compaction
+    t.insert(static_cast<ItemType>(N));
+    t.insert(static_cast<ItemType>(-1));
+    EXPECT_EQ(t.count(), static_cast<size_t>(N + 2));
+    EXPECT_TRUE(t.find(static_cast<ItemType>(N)) != nullptr);
+    EXPECT_EQ(t.memoryUsage().nodeBytes, (N + 2) * sizeof(BinaryTreeNode));
+
+    // only trees with hashing enabled pay for the digest
+    AVLTree hashed = t;
+    hashed.enableHashing();
+    EXPECT_TRUE(sizeof(BinaryTreeNode) < sizeof(HashedBinaryTreeNode));
+    EXPECT_EQ(hashed.memoryUsage().nodeBytes, (N + 2) * sizeof(HashedBinaryTreeNode));
+    EXPECT_VEC_EQ(hashed.inorder(), t.inorder(), "inorder after enableHashing");
+    EXPECT_EQ(hashed.rootHash(), t.rootHash());
+    EXPECT_TRUE(t.find(5)->hash() == 0);
+    EXPECT_TRUE(hashed.find(5)->hash() != 0);
+    hashed.insert(static_cast<ItemType>(N + 1));
+    EXPECT_EQ(hashed.memoryUsage().nodeBytes, (N + 3) * sizeof(HashedBinaryTreeNode));
+
+    // copies and assignment take the source's node type, whatever the destination had before
+    AVLTree copied(hashed);
+    AVLTree assigned;
+    assigned = hashed;
+    AVLTree unhashed = hashed;
+    unhashed = t;
+    hashed.insert(static_cast<ItemType>(N + 2));
+    copied.insert(static_cast<ItemType>(N + 2));
+    assigned.insert(static_cast<ItemType>(N + 2));
+    unhashed.insert(static_cast<ItemType>(N + 2));
+    EXPECT_TRUE(copied.isHashing() && assigned.isHashing() && !unhashed.isHashing());
+    EXPECT_EQ(copied.rootHash(), hashed.rootHash());
+    EXPECT_EQ(assigned.rootHash(), hashed.rootHash());
+    EXPECT_EQ(assigned.memoryUsage().nodeBytes, (N + 4) * sizeof(HashedBinaryTreeNode));
+    EXPECT_EQ(unhashed.memoryUsage().nodeBytes, (N + 3) * sizeof(BinaryTreeNode));
+    EXPECT_TRUE(unhashed.find(5)->hash() == 0);
+
+    AVLTree copy = t;
+    t.clear();
+    EXPECT_EQ(t.memoryUsage().totalBytes(), static_cast<size_t>(0));
+    EXPECT_EQ(copy.count(), static_cast<size_t>(N + 2));
+}
+
+// walks the tree forward and backward through parent links and returns the number of items seen
+template <typename Tree>
+static size_t count_by_traversal(const Tree& t) {
+    size_t items = 0, steps = 0;
+    for (auto n = t.minimumNode(); n != nullptr; n = t.nextLargestNode(n)) { items += n->multiplicity(); ++steps; }
+    auto back = t.maximumNode();
+    for (size_t i = 1; i < steps; ++i) back = t.nextSmallestNode(back);
+    EXPECT_TRUE(back == t.minimumNode());
+    return items;
+}
+
+static void test_multiset_mode() {
+    std::cout << "\n== test_multiset_mode ==\n";
+    AVLTree t(true);
+    EXPECT_TRUE(t.isMultiset());
+    std::vector<ItemType> data = { 5, 3, 5, 8, 5, 3, 1, 9, 8 };
+    for (auto v : data) t.insert(v);
+
+    EXPECT_EQ(t.count(), data.size());
+    EXPECT_EQ(t.count(5), static_cast<size_t>(3));
+    EXPECT_EQ(t.count(3), static_cast<size_t>(2));
+    EXPECT_EQ(t.count(7), static_cast<size_t>(0));
+    EXPECT_EQ(t.find(5)->multiplicity(), static_cast<size_t>(3));
+
+    auto want = data; std::sort(want.begin(), want.end());
+    EXPECT_VEC_EQ(t.inorder(), want, "multiset inorder");
+    EXPECT_VEC_EQ(std::vector<ItemType>(t.begin(), t.end()), want, "multiset iteration");
+    EXPECT_EQ(t.preorder().size(), data.size());
+    EXPECT_EQ(t.postorder().size(), data.size());
+    EXPECT_EQ(count_by_traversal(t), data.size());
+
+    // erasing one copy keeps the node until the last copy is gone
+    auto n5 = t.find(5);
+    EXPECT_TRUE(t.eraseOne(5));
+    EXPECT_EQ(t.count(5), static_cast<size_t>(2));
+    EXPECT_TRUE(t.find(5) == n5);
+    EXPECT_TRUE(t.eraseOne(5));
+    EXPECT_TRUE(t.eraseOne(5));
+    EXPECT_TRUE(t.find(5) == nullptr);
+    EXPECT_TRUE(!t.eraseOne(5));
+    EXPECT_TRUE(!t.eraseOne(42));
+    EXPECT_EQ(t.count(), data.size() - 3);
+    std::vector<ItemType> rest = { 1, 3, 3, 8, 8, 9 };
+    EXPECT_VEC_EQ(t.inorder(), rest, "multiset inorder after eraseOne");
+
+    AVLTree copy = t;
+    EXPECT_TRUE(copy.isMultiset());
+    EXPECT_EQ(copy.count(8), static_cast<size_t>(2));
+    copy.shrinkToFit();
+    EXPECT_VEC_EQ(copy.inorder(), rest, "multiset inorder after shrinkToFit");
+
+    long long sum = t.mapReduce([](const ItemType& x) { return static_cast<long long>(x); },
+        [](long long a, long long b) { return a + b; }, 0LL);
+    EXPECT_EQ(sum, 32LL);
+
+    // a set ignores duplicates but still supports eraseOne
+    AVLTree s;
+    s.insert(1); s.insert(1);
+    EXPECT_EQ(s.count(1), static_cast<size_t>(1));
+    EXPECT_TRUE(s.eraseOne(1));
+    EXPECT_EQ(s.count(), static_cast<size_t>(0));
+}
+
+static void test_erase_keeps_balance() {
+    std::cout << "\n== test_erase_keeps_balance ==\n";
+    AVLTree t;
+    const int N = 2000;
+    for (int i = 0; i < N; ++i) t.insert(static_cast<ItemType>((i * 7) % N));
+    // remove every item not divisible by 3, in a scattered order
+    std::vector<ItemType> want;
+    for (int i = 0; i < N; ++i) {
+        ItemType x = static_cast<ItemType>((i * 13) % N);
+        if (x % 3 != 0) EXPECT_TRUE(t.eraseOne(x));
+    }
+    for (int i = 0; i < N; i += 3) want.push_back(static_cast<ItemType>(i));
+    EXPECT_VEC_EQ(t.inorder(), want, "inorder after erasing");
+    EXPECT_EQ(t.count(), want.size());
+    EXPECT_EQ(count_by_traversal(t), want.size());
+
+    // an AVL tree with n nodes is at most about 1.44 log2(n) high
+    int height = t.find(t.preorder().front())->height();
+    EXPECT_TRUE(height <= 1.45 * std::log2(static_cast<double>(want.size()) + 2));
+
+    for (auto v : want) EXPECT_TRUE(t.eraseOne(v));
+    EXPECT_EQ(t.count(), static_cast<size_t>(0));
+    EXPECT_TRUE(t.minimumNode() == nullptr);
+}
+
+static void test_find_cache() {
+    std::cout << "\n== test_find_cache ==\n";
+    AVLTree t;
+    for (int i = 0; i < 100; ++i) t.insert(static_cast<ItemType>(i));
+    EXPECT_EQ(t.findCacheSize(), static_cast<size_t>(0));
+    t.find(5);
+    EXPECT_EQ(t.findCacheMisses(), static_cast<size_t>(0));
+
+    t.enableFindCache(12);
+    EXPECT_EQ(t.findCacheSize(), static_cast<size_t>(16));
+    auto n42 = t.find(42);
+    EXPECT_TRUE(n42 != nullptr);
+    EXPECT_EQ(t.findCacheMisses(), static_cast<size_t>(1));
+    for (int i = 0; i < 10; ++i) expect_same_node(t.find(42), n42, "cached find(42)");
+    EXPECT_EQ(t.findCacheHits(), static_cast<size_t>(10));
+    EXPECT_TRUE(t.find(1000) == nullptr);
+    EXPECT_EQ(t.findCacheMisses(), static_cast<size_t>(2));
+
+    // uncached lookups neither count nor fill the cache
+    expect_same_node(t.findUncached(42), n42, "findUncached(42)");
+    EXPECT_TRUE(t.findUncached(1000) == nullptr);
+    EXPECT_TRUE(t.findUncached(43) != nullptr);
+    EXPECT_EQ(t.findCacheHits(), static_cast<size_t>(10));
+    EXPECT_EQ(t.findCacheMisses(), static_cast<size_t>(2));
+    t.find(43);
+    EXPECT_EQ(t.findCacheMisses(), static_cast<size_t>(3));
+
+    // rotations caused by inserts do not change which node holds an item
+    for (int i = 100; i < 200; ++i) t.insert(static_cast<ItemType>(i));
+    expect_same_node(t.find(42), n42, "cached find(42) after inserts");
+
+    // erase must drop the entry
+    EXPECT_TRUE(t.eraseOne(42));
+    EXPECT_TRUE(t.find(42) == nullptr);
+    t.insert(42);
+    EXPECT_TRUE(t.find(42) != nullptr);
+    EXPECT_TRUE(t.find(42) != n42);
+
+    // removing a node with two children splices its successor in; the successor's entry stays valid
+    auto n43 = t.find(43);
+    EXPECT_TRUE(t.eraseOne(t.find(100)->item()));
+    expect_same_node(t.find(43), n43, "cached find(43) after erase elsewhere");
+
+    // structural replacement of every node drops all entries
+    t.shrinkToFit();
+    EXPECT_TRUE(t.find(43) != n43);
+    EXPECT_EQ(t.find(43)->item(), static_cast<ItemType>(43));
+    t.clear();
+    EXPECT_TRUE(t.find(43) == nullptr);
+
+    // every lookup still returns the right node when the cache is much smaller than the tree
+    for (int i = 0; i < 1000; ++i) t.insert(static_cast<ItemType>(i));
+    for (int round = 0; round < 3; ++round)
+        for (int i = 0; i < 1000; i += 7) EXPECT_EQ(t.find(static_cast<ItemType>(i))->item(), static_cast<ItemType>(i));
+    EXPECT_TRUE(t.findCacheHits() > 0);
+
+    // copies and assignment take the source's cache size with empty entries that refer to their own nodes
+    AVLTree copy(t);
+    EXPECT_EQ(copy.findCacheSize(), t.findCacheSize());
+    EXPECT_EQ(copy.findCacheHits(), static_cast<size_t>(0));
+    EXPECT_TRUE(copy.find(7) != t.find(7));
+    EXPECT_EQ(copy.findCacheMisses(), static_cast<size_t>(1));
+    AVLTree assigned;
+    assigned.enableFindCache(4);
+    assigned = t;
+    EXPECT_EQ(assigned.findCacheSize(), t.findCacheSize());
+    EXPECT_EQ(assigned.findCacheHits(), static_cast<size_t>(0));
+    EXPECT_TRUE(assigned.find(7) != t.find(7));
+
+    t.enableFindCache(0);
+    EXPECT_EQ(t.findCacheSize(), static_cast<size_t>(0));
+    EXPECT_TRUE(t.find(7) != nullptr);
+}
+
+static void test_block_tree_against_std_set() {
+    std::cout << "\n== test_block_tree_against_std_set ==\n";
+    BlockAVLTree t;
+    std::set<ItemType> ref;
+    EXPECT_TRUE(!t.contains(0));
+    EXPECT_EQ(t.height(), -1);
+
+    // ascending inserts fill and split blocks at the right edge
+    for (int i = 0; i < 1000; ++i) { t.insert(static_cast<ItemType>(2 * i)); ref.insert(2 * i); }
+    EXPECT_EQ(t.count(), ref.size());
+    EXPECT_TRUE(t.blockCount() < ref.size() / 8);
+    EXPECT_VEC_EQ(t.inorder(), std::vector<ItemType>(ref.begin(), ref.end()), "block ascending inorder");
+
+    // pseudo-random mix of inserts and erases
+    unsigned int state = 12345;
+    for (int step = 0; step < 20000; ++step) {
+        state = state * 1103515245u + 12345u;
+        ItemType x = static_cast<ItemType>((state >> 8) % 3000) - 500;
+        if ((state >> 4) % 3 == 0) {
+            EXPECT_EQ(t.eraseOne(x), ref.erase(x) == 1);
+        } else {
+            t.insert(x);
+            ref.insert(x);
+        }
+    }
+    EXPECT_EQ(t.count(), ref.size());
+    EXPECT_VEC_EQ(t.inorder(), std::vector<ItemType>(ref.begin(), ref.end()), "block random inorder");
+    EXPECT_TRUE(t.height() <= 1.45 * std::log2(static_cast<double>(t.blockCount()) + 2));
+    for (ItemType x = -600; x < 2600; ++x) {
+        if (t.contains(x) != (ref.count(x) == 1)) {
+            EXPECT_TRUE(t.contains(x) == (ref.count(x) == 1));
+            break;
+        }
+    }
+    auto block = t.findBlock(*ref.begin());
+    EXPECT_TRUE(block != nullptr && block->minimumItem() == *ref.begin());
+
+    // draining the tree merges and removes blocks
+    BlockAVLTree copy = t;
+    for (auto x : ref) EXPECT_TRUE(t.eraseOne(x));
+    EXPECT_EQ(t.count(), static_cast<size_t>(0));
+    EXPECT_EQ(t.blockCount(), static_cast<size_t>(0));
+    EXPECT_EQ(copy.count(), ref.size());
+    EXPECT_VEC_EQ(copy.inorder(), std::vector<ItemType>(ref.begin(), ref.end()), "block copy inorder");
+}
+
+static void test_hash_diff_and_delta_sync() {
+    std::cout << "\n== test_hash_diff_and_delta_sync ==\n";
+    AVLTree a, b;
+    a.enableHashing();
+    EXPECT_TRUE(a.isHashing());
+    EXPECT_EQ(a.rootHash(), b.rootHash());
+
+    // same items inserted in different orders give differently shaped trees with equal digests
+    const int N = 5000;
+    for (int i = 0; i < N; ++i) a.insert(static_cast<ItemType>(i * 3));
+    for (int i = N - 1; i >= 0; --i) b.insert(static_cast<ItemType>(i * 3));
+    EXPECT_TRUE(a.preorder() != b.preorder());
+    EXPECT_EQ(a.rootHash(), b.rootHash());
+    EXPECT_TRUE(a.diff(b).empty());
+    b.enableHashing();
+    EXPECT_EQ(a.rootHash(), b.rootHash());
+
+    RangeDigest d = a.rangeDigest(30, 59);
+    EXPECT_EQ(d.count, static_cast<size_t>(10));
+    EXPECT_TRUE(d == b.rangeDigest(28, 59));
+    EXPECT_EQ(a.rangeDigest(59, 30).count, static_cast<size_t>(0));
+
+    // a few scattered changes on the replica
+    b.eraseOne(300);
+    b.eraseOne(303);
+    b.insert(7001);
+    b.insert(-5);
+    EXPECT_TRUE(a.rootHash() != b.rootHash());
+    auto ranges = a.diff(b);
+    EXPECT_TRUE(!ranges.empty() && ranges.size() <= 3);
+    for (const auto& range : ranges) EXPECT_TRUE(a.rangeDigest(range.first, range.second) != b.rangeDigest(range.first, range.second));
+    bool covers300 = false, covers7001 = false;
+    for (const auto& range : ranges) {
+        covers300 = covers300 || (range.first <= 300 && 303 <= range.second);
+        covers7001 = covers7001 || (range.first <= 7001 && 7001 <= range.second);
+    }
+    EXPECT_TRUE(covers300);
+    EXPECT_TRUE(covers7001);
+
+    // shipping the delta for the differing ranges makes b equal to a
+    std::vector<uint8_t> delta = a.encodeDelta(ranges);
+    EXPECT_TRUE(delta.size() < 200);
+    EXPECT_TRUE(b.applyDelta(delta));
+    EXPECT_EQ(b.rootHash(), a.rootHash());
+    EXPECT_VEC_EQ(b.inorder(), a.inorder(), "inorder after applyDelta");
+    EXPECT_TRUE(a.diff(b).empty());
+
+    // malformed deltas are rejected without changing the tree
+    std::vector<uint8_t> truncated(delta.begin(), delta.end() - 1);
+    EXPECT_TRUE(!b.applyDelta(truncated));
+    EXPECT_TRUE(!b.applyDelta(std::vector<uint8_t>()));
+    EXPECT_EQ(b.rootHash(), a.rootHash());
+
+    // multiplicities take part in digests and deltas
+    AVLTree m(true), n(true);
+    m.enableHashing();
+    for (int i = 0; i < 100; ++i) { m.insert(static_cast<ItemType>(i % 10)); n.insert(static_cast<ItemType>(i % 10)); }
+    EXPECT_EQ(m.rootHash(), n.rootHash());
+    n.insert(4);
+    m.eraseOne(6);
+    auto mranges = m.diff(n);
+    EXPECT_TRUE(!mranges.empty());
+    EXPECT_TRUE(n.applyDelta(m.encodeDelta(mranges)));
+    EXPECT_EQ(n.count(4), static_cast<size_t>(10));
+    EXPECT_EQ(n.count(6), static_cast<size_t>(9));
+    EXPECT_EQ(n.rootHash(), m.rootHash());
+
+    // a hot item is synced by setting its multiplicity, not copy by copy
+    auto varint = [](std::vector<uint8_t>& bytes, uint64_t value) {
+        for (; value >= 0x80; value >>= 7) bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        bytes.push_back(static_cast<uint8_t>(value));
+    };
+    const uint64_t key4 = static_cast<uint64_t>(4) ^ (static_cast<uint64_t>(1) << 63);
+    std::vector<uint8_t> hot;
+    varint(hot, 1); varint(hot, key4); varint(hot, 0); varint(hot, 1); varint(hot, 0); varint(hot, 10000000);
+    AVLTree h(true);
+    h.enableHashing();
+    EXPECT_TRUE(h.applyDelta(hot));
+    EXPECT_EQ(h.count(4), static_cast<size_t>(10000000));
+    EXPECT_EQ(h.count(), static_cast<size_t>(10000000));
+    EXPECT_TRUE(n.applyDelta(h.encodeDelta(n.diff(h))));
+    EXPECT_EQ(n.count(4), static_cast<size_t>(10000000));
+    EXPECT_EQ(n.rootHash(), h.rootHash());
+    EXPECT_TRUE(h.applyDelta(m.encodeDelta(h.diff(m))));
+    EXPECT_EQ(h.rootHash(), m.rootHash());
+    EXPECT_VEC_EQ(h.inorder(), m.inorder(), "inorder after syncing back");
+
+    // a node holds at most maxMultiplicity copies; further copies are ignored and larger deltas rejected
+    std::vector<uint8_t> full;
+    varint(full, 1); varint(full, key4); varint(full, 0); varint(full, 1); varint(full, 0); varint(full, BinaryTreeNode::maxMultiplicity);
+    AVLTree saturated(true);
+    EXPECT_TRUE(saturated.applyDelta(full));
+    saturated.insert(4);
+    saturated.applyBatch({ { BatchOperation::Insert, 4 } });
+    EXPECT_EQ(saturated.count(4), static_cast<size_t>(BinaryTreeNode::maxMultiplicity));
+    full.back() = 0x10;
+    EXPECT_TRUE(!saturated.applyDelta(full));
+    std::vector<uint8_t> huge;
+    varint(huge, 1); varint(huge, key4); varint(huge, 1); varint(huge, 2);
+    varint(huge, 0); varint(huge, ~static_cast<uint64_t>(0) >> 1); varint(huge, 1); varint(huge, ~static_cast<uint64_t>(0) >> 1);
+    EXPECT_TRUE(!h.applyDelta(huge));
+    EXPECT_EQ(h.rootHash(), m.rootHash());
+
+    // extreme items survive the encoding
+    AVLTree e, f;
+    e.insert(std::numeric_limits<int>::min());
+    e.insert(std::numeric_limits<int>::max());
+    EXPECT_TRUE(f.applyDelta(e.encodeDelta(e.diff(f))));
+    EXPECT_VEC_EQ(f.inorder(), e.inorder(), "extreme items after applyDelta");
+}
+
+static void test_apply_batch_matches_sequential() {
+    std::cout << "\n== test_apply_batch_matches_sequential ==\n";
+    for (int multiset = 0; multiset <= 1; ++multiset) {
+        AVLTree batched(multiset == 1), sequential(multiset == 1);
+        batched.enableHashing();
+        batched.enableFindCache(64);
+        unsigned int state = 777u + multiset;
+        for (int round = 0; round < 6; ++round) {
+            // batches grow from a handful of operations to tens of thousands
+            std::vector<BatchOperation> batch;
+            size_t size = static_cast<size_t>(10) << (2 * round);
+            for (size_t i = 0; i < size; ++i) {
+                state = state * 1103515245u + 12345u;
+                ItemType x = static_cast<ItemType>((state >> 8) % 20000);
+                BatchOperation::Kind kind = ((state >> 4) % 3 == 0) ? BatchOperation::Erase : BatchOperation::Insert;
+                batch.push_back({ kind, x });
+            }
+            // repeated operations on one item must keep their order
+            batch.push_back({ BatchOperation::Insert, 5 });
+            batch.push_back({ BatchOperation::Erase, 5 });
+            batch.push_back({ BatchOperation::Insert, 5 });
+            batch.push_back({ BatchOperation::Insert, 5 });
+            batch.push_back({ BatchOperation::Erase, 6 });
+            batch.push_back({ BatchOperation::Insert, 6 });
+
+            for (const auto& op : batch) {
+                if (op.kind == BatchOperation::Insert) sequential.insert(op.item);
+                else sequential.eraseOne(op.item);
+            }
+            batched.find(5);
+            batched.applyBatch(batch);
+            EXPECT_EQ(batched.count(), sequential.count());
+            EXPECT_VEC_EQ(batched.inorder(), sequential.inorder(), "applyBatch inorder");
+            EXPECT_EQ(batched.rootHash(), sequential.rootHash());
+            EXPECT_EQ(count_by_traversal(batched), batched.count());
+            EXPECT_EQ(batched.count(5), sequential.count(5));
+        }
+        int height = batched.find(batched.preorder().front())->height();
+        EXPECT_TRUE(height <= 1.45 * std::log2(static_cast<double>(batched.count()) + 2));
+
+        // erasing everything in one batch empties the tree
+        std::vector<BatchOperation> drain;
+        for (auto x : batched.inorder()) drain.push_back({ BatchOperation::Erase, x });
+        batched.applyBatch(drain);
+        EXPECT_EQ(batched.count(), static_cast<size_t>(0));
+        EXPECT_TRUE(batched.find(5) == nullptr);
+        batched.applyBatch(std::vector<BatchOperation>());
+        EXPECT_TRUE(batched.minimumNode() == nullptr);
+    }
+}
+
+// checks the rank rule of WeakAVLBalance below node and returns the number of nodes
+static size_t check_wavl_ranks(const std::shared_ptr<BinaryTreeNode>& node) {
+    if (node == nullptr) return 0;
+    auto left = node->leftNode(), right = node->rightNode();
+    int dl = node->height() - getHeight(left), dr = node->height() - getHeight(right);
+    if (left == nullptr && right == nullptr) EXPECT_EQ(node->height(), 0);
+    EXPECT_TRUE(dl == 1 || dl == 2);
+    EXPECT_TRUE(dr == 1 || dr == 2);
+    if (left != nullptr) EXPECT_TRUE(left->item() < node->item());
+    if (right != nullptr) EXPECT_TRUE(node->item() < right->item());
+    return 1 + check_wavl_ranks(left) + check_wavl_ranks(right);
+}
+
+template <typename Tree>
+static void run_churn(Tree& t, std::multiset<ItemType>& ref, unsigned int seed, int steps) {
+    unsigned int state = seed;
+    for (int step = 0; step < steps; ++step) {
+        state = state * 1103515245u + 12345u;
+        ItemType x = static_cast<ItemType>((state >> 8) % 4000);
+        if ((state >> 4) % 2 == 0) {
+            auto it = ref.find(x);
+            bool present = it != ref.end();
+            if (present) ref.erase(it);
+            EXPECT_EQ(t.eraseOne(x), present);
+        } else {
+            if (t.isMultiset() || ref.count(x) == 0) ref.insert(x);
+            t.insert(x);
+        }
+    }
+}
+
+static void test_weak_avl_policy() {
+    std::cout << "\n== test_weak_avl_policy ==\n";
+    for (int multiset = 0; multiset <= 1; ++multiset) {
+        WAVLTree t(multiset == 1);
+        AVLTree a(multiset == 1);
+        std::multiset<ItemType> ref;
+        for (int i = 0; i < 3000; ++i) {
+            t.insert(static_cast<ItemType>(i));
+            a.insert(static_cast<ItemType>(i));
+            ref.insert(static_cast<ItemType>(i));
+        }
+        // without removals a weak AVL tree is an AVL tree
+        EXPECT_EQ(t.height(), a.height());
+        EXPECT_EQ(t.rotationCount(), a.rotationCount());
+
+        std::multiset<ItemType> aref = ref;
+        run_churn(t, ref, 99u, 30000);
+        run_churn(a, aref, 99u, 30000);
+        EXPECT_VEC_EQ(t.inorder(), std::vector<ItemType>(ref.begin(), ref.end()), "WAVL churn inorder");
+        EXPECT_VEC_EQ(a.inorder(), t.inorder(), "AVL and WAVL agree");
+        EXPECT_EQ(count_by_traversal(t), t.count());
+        size_t nodes = check_wavl_ranks(t.find(t.preorder().front()));
+        EXPECT_TRUE(t.height() <= 2 * std::log2(static_cast<double>(nodes) + 1));
+        EXPECT_TRUE(t.rotationCount() < a.rotationCount());
+        std::cout << "[INFO] rotations AVL " << a.rotationCount() << ", WAVL " << t.rotationCount()
+            << "; height AVL " << a.height() << ", WAVL " << t.height() << "\n";
+
+        // batches, hashing and copies work with either policy
+        t.enableHashing();
+        std::vector<BatchOperation> batch;
+        for (int i = 0; i < 5000; ++i) batch.push_back({ i % 3 ? BatchOperation::Insert : BatchOperation::Erase, static_cast<ItemType>((i * 31) % 6000) });
+        for (const auto& op : batch) {
+            if (op.kind == BatchOperation::Insert) a.insert(op.item);
+            else a.eraseOne(op.item);
+        }
+        t.applyBatch(batch);
+        EXPECT_VEC_EQ(t.inorder(), a.inorder(), "WAVL applyBatch inorder");
+        EXPECT_EQ(t.rootHash(), a.rootHash());
+        check_wavl_ranks(t.find(t.preorder().front()));
+        WAVLTree copy = t;
+        copy.shrinkToFit();
+        EXPECT_VEC_EQ(copy.inorder(), t.inorder(), "WAVL copy inorder");
+
+        for (auto x : t.inorder()) t.eraseOne(x);
+        EXPECT_EQ(t.count(), static_cast<size_t>(0));
+        EXPECT_EQ(t.height(), -1);
+    }
+}
+
+static void test_trace_record_and_read() {
+    std::cout << "\n== test_trace_record_and_read ==\n";
+    std::ostringstream out(std::ios::binary);
+    std::vector<TraceEvent> want;
+    {
+        TraceRecorder recorder(out, 16);
+        AVLTree t;
+        t.insert(-3); // not recorded yet
+        t.setTraceRecorder(&recorder);
+        EXPECT_TRUE(t.traceRecorder() == &recorder);
+        for (int i = 0; i < 50; ++i) {
+            t.insert(static_cast<ItemType>(i * 7));
+            want.push_back({ TraceEvent::Insert, static_cast<ItemType>(i * 7) });
+        }
+        t.insert(std::numeric_limits<ItemType>::min());
+        t.insert(std::numeric_limits<ItemType>::max());
+        want.push_back({ TraceEvent::Insert, std::numeric_limits<ItemType>::min() });
+        want.push_back({ TraceEvent::Insert, std::numeric_limits<ItemType>::max() });
+        auto node = t.find(14);
+        t.nextLargestNode(node);
+        t.nextSmallestNode(node);
+        t.nextLargestNode(nullptr); // does nothing, so nothing is recorded
+        t.minimumNode();
+        t.maximumNode();
+        want.push_back({ TraceEvent::Find, 14 });
+        want.push_back({ TraceEvent::NextLargest, 14 });
+        want.push_back({ TraceEvent::NextSmallest, 14 });
+        want.push_back({ TraceEvent::Minimum, 0 });
+        want.push_back({ TraceEvent::Maximum, 0 });
+        EXPECT_TRUE(t.eraseOne(21));
+        want.push_back({ TraceEvent::Erase, 21 });
+        t.inorder();
+        t.preorder();
+        t.postorder();
+        t.forEach([](const ItemType&) {});
+        t.mapReduce([](const ItemType&) { return static_cast<size_t>(1); }, [](size_t a, size_t b) { return a + b; }, static_cast<size_t>(0));
+        // the uncached lookup is not recorded
+        EXPECT_TRUE(t.findUncached(14) != nullptr);
+        want.push_back({ TraceEvent::Inorder, 0 });
+        want.push_back({ TraceEvent::Preorder, 0 });
+        want.push_back({ TraceEvent::Postorder, 0 });
+        want.push_back({ TraceEvent::ForEach, 0 });
+        want.push_back({ TraceEvent::ForEach, 0 });
+        t.applyBatch({ { BatchOperation::Erase, 0 }, { BatchOperation::Insert, 5 } });
+        want.push_back({ TraceEvent::Erase, 0 });
+        want.push_back({ TraceEvent::Insert, 5 });
+        // copies do not record
+        AVLTree copy = t;
+        EXPECT_TRUE(copy.traceRecorder() == nullptr);
+        copy.insert(1000);
+        t.clear();
+        want.push_back({ TraceEvent::Clear, 0 });
+        EXPECT_EQ(recorder.eventCount(), want.size());
+        t.setTraceRecorder(nullptr);
+        t.insert(1);
+    }
+    std::string bytes = out.str();
+    // small steps between items take two bytes per record
+    EXPECT_TRUE(bytes.size() < 5 + 3 * want.size() + 2 * 10);
+
+    std::istringstream in(bytes, std::ios::binary);
+    std::vector<TraceEvent> got;
+    EXPECT_TRUE(readTrace(in, got));
+    EXPECT_EQ(got.size(), want.size());
+    for (size_t i = 0; i < std::min(got.size(), want.size()); ++i) {
+        EXPECT_EQ(static_cast<int>(got[i].kind), static_cast<int>(want[i].kind));
+        EXPECT_EQ(got[i].item, want[i].item);
+    }
+    EXPECT_EQ(std::string(traceKindName(TraceEvent::NextLargest)), std::string("nextLargest"));
+
+    // truncated records, unknown kinds and foreign data are rejected
+    std::vector<TraceEvent> bad;
+    std::istringstream truncated(bytes.substr(0, 6) + std::string(1, static_cast<char>(0x80)), std::ios::binary);
+    EXPECT_TRUE(!readTrace(truncated, bad));
+    std::istringstream unknown(bytes.substr(0, 5) + std::string(1, static_cast<char>(TraceEvent::KindCount)), std::ios::binary);
+    EXPECT_TRUE(!readTrace(unknown, bad));
+    std::istringstream foreign(std::string("not a trace"), std::ios::binary);
+    EXPECT_TRUE(!readTrace(foreign, bad));
+    std::istringstream empty(bytes.substr(0, 5), std::ios::binary);
+    bad.clear();
+    EXPECT_TRUE(readTrace(empty, bad));
+    EXPECT_TRUE(bad.empty());
+}
+
+// built at compile time; every check on it below is evaluated by the compiler
+static constexpr auto static_primes = makeStaticAVLTree({ 29, 2, 23, 3, 19, 5, 17, 7, 13, 11, 7, 2 });
+static_assert(static_primes.count() == 10, "duplicates are stored once");
+static_assert(static_primes.height() == 3, "10 items are 4 levels deep");
+static_assert(static_primes.contains(13) && !static_primes.contains(4) && !static_primes.contains(30), "constexpr find");
+static_assert(*static_primes.minimumNode() == 2 && *static_primes.maximumNode() == 29, "constexpr minimum and maximum");
+static_assert(*static_primes.nextLargestNode(static_primes.find(13)) == 17, "constexpr successor");
+static_assert(static_primes.nextLargestNode(static_primes.maximumNode()) == nullptr, "no successor of the maximum");
+
+template <size_t N>
+static void check_static_tree_against_std_set(unsigned int& state, int range) {
+    ItemType items[N];
+    std::set<ItemType> ref;
+    for (size_t i = 0; i < N; ++i) {
+        state = state * 1103515245u + 12345u;
+        items[i] = static_cast<ItemType>(static_cast<int>((state >> 8) % range) - range / 2);
+        ref.insert(items[i]);
+    }
+    StaticAVLTree<N> t(items);
+    EXPECT_EQ(t.count(), ref.size());
+    EXPECT_VEC_EQ(std::vector<ItemType>(t.begin(), t.end()), std::vector<ItemType>(ref.begin(), ref.end()), "static inorder");
+    for (int x = -range / 2 - 2; x <= range / 2 + 2; ++x) {
+        auto node = t.find(static_cast<ItemType>(x));
+        EXPECT_EQ(node != nullptr, ref.count(static_cast<ItemType>(x)) == 1);
+        if (node) EXPECT_EQ(*node, static_cast<ItemType>(x));
+    }
+    // walk forwards and backwards with the successor API
+    std::vector<ItemType> forward, backward;
+    for (auto node = t.minimumNode(); node; node = t.nextLargestNode(node)) forward.push_back(*node);
+    for (auto node = t.maximumNode(); node; node = t.nextSmallestNode(node)) backward.push_back(*node);
+    std::reverse(backward.begin(), backward.end());
+    EXPECT_VEC_EQ(forward, std::vector<ItemType>(ref.begin(), ref.end()), "static successors");
+    EXPECT_VEC_EQ(backward, forward, "static predecessors");
+    EXPECT_TRUE(t.nextLargestNode(nullptr) == nullptr);
+    EXPECT_TRUE(t.nextSmallestNode(nullptr) == nullptr);
+    EXPECT_EQ(t.height(), static_cast<int>(std::floor(std::log2(static_cast<double>(ref.size())))));
+}
+
+static void test_static_tree() {
+    std::cout << "\n== test_static_tree ==\n";
+    unsigned int state = 35u;
+    for (int round = 0; round < 20; ++round) {
+        check_static_tree_against_std_set<1>(state, 4);
+        check_static_tree_against_std_set<2>(state, 4);
+        check_static_tree_against_std_set<7>(state, 10);
+        check_static_tree_against_std_set<16>(state, 40);
+        check_static_tree_against_std_set<33>(state, 30);
+        check_static_tree_against_std_set<100>(state, 300);
+    }
+    const ItemType extremes[] = { std::numeric_limits<ItemType>::max(), std::numeric_limits<ItemType>::min(), 0 };
+    StaticAVLTree<3> t(extremes);
+    EXPECT_TRUE(t.contains(std::numeric_limits<ItemType>::max()));
+    EXPECT_TRUE(t.contains(std::numeric_limits<ItemType>::min()));
+    EXPECT_TRUE(!t.contains(1));
+    EXPECT_EQ(*t.minimumNode(), std::numeric_limits<ItemType>::min());
+}
+
+static void test_deferred_reclamation() {
+    std::cout << "\n== test_deferred_reclamation ==\n";
+    auto incremental = std::make_shared<NodeReclaimer>(NodeReclaimer::Incremental, 1000000, 64);
+    AVLTree t;
+    t.setReclaimer(incremental);
+    EXPECT_TRUE(t.reclaimer() == incremental);
+    for (int i = 0; i < 20000; ++i) t.insert(static_cast<ItemType>(i));
+    t.enableFindCache(64);
+    auto kept = t.find(500);
+
+    // clear only detaches the nodes
+    EXPECT_EQ(t.nodeCount(), static_cast<size_t>(20000));
+    t.clear();
+    EXPECT_EQ(t.count(), static_cast<size_t>(0));
+    EXPECT_EQ(t.nodeCount(), static_cast<size_t>(0));
+    EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(20000));
+    // every modification frees one step
+    for (int i = 0; i < 10; ++i) t.insert(static_cast<ItemType>(i));
+    EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(20000 - 10 * 64));
+    EXPECT_EQ(incremental->reclaim(100), static_cast<size_t>(100));
+    // the node kept alive below is walked through, so the count still comes out exact
+    incremental->drain();
+    EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(0));
+    EXPECT_EQ(incremental->reclaim(100), static_cast<size_t>(0));
+    // nodes referenced elsewhere stay usable
+    EXPECT_EQ(kept->item(), static_cast<ItemType>(500));
+    EXPECT_VEC_EQ(t.inorder(), std::vector<ItemType>({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }), "tree reused after clear");
+
+    // assignment, destruction and shrinkToFit hand their nodes over too, and copies share the reclaimer
+    AVLTree source;
+    for (int i = 0; i < 300; ++i) source.insert(static_cast<ItemType>(i));
+    t = source;
+    EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(10));
+    {
+        AVLTree copy(t);
+        EXPECT_TRUE(copy.reclaimer() == incremental);
+    }
+    EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(310));
+    // shrinkToFit first frees one step like any other modification
+    t.shrinkToFit();
+    EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(310 - 64 + 300));
+    EXPECT_VEC_EQ(t.inorder(), source.inorder(), "inorder after shrinkToFit");
+    incremental->drain();
+
+    // a multiset node counts once however many copies it holds
+    AVLTree multi(true);
+    multi.setReclaimer(incremental);
+    for (int i = 0; i < 100; ++i) multi.insert(static_cast<ItemType>(i % 10));
+    EXPECT_EQ(multi.nodeCount(), static_cast<size_t>(10));
+    multi.clear();
+    EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(10));
+    incremental->drain();
+
+    // a workload that only deletes advances the reclaimer too, whether it marks items, erases them in batches or applies deltas
+    for (int round = 0; round < 3; ++round) {
+        AVLTree d;
+        d.setReclaimer(incremental);
+        for (int i = 0; i < 2000; ++i) d.insert(static_cast<ItemType>(i));
+        AVLTree retired(d);
+        retired.clear();
+        EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(2000));
+        for (int i = 0; i < 10; ++i) {
+            if (round == 0) {
+                EXPECT_TRUE(d.markDeleted(static_cast<ItemType>(i)));
+            } else if (round == 1) {
+                d.applyBatch({ { BatchOperation::Erase, static_cast<ItemType>(i) } });
+            } else {
+                // an empty range in the delta removes the item
+                EXPECT_TRUE(d.applyDelta(AVLTree().encodeDelta({ ItemRange(static_cast<ItemType>(i), static_cast<ItemType>(i)) })));
+            }
+        }
+        EXPECT_EQ(d.count(), static_cast<size_t>(1990));
+        EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(2000 - 10 * 64));
+        incremental->drain();
+    }
+
+    // past the cap the caller frees only the excess
+    auto capped = std::make_shared<NodeReclaimer>(NodeReclaimer::Incremental, 1000);
+    AVLTree big;
+    big.setReclaimer(capped);
+    for (int i = 0; i < 5000; ++i) big.insert(static_cast<ItemType>(i));
+    big.clear();
+    EXPECT_EQ(capped->pendingNodes(), static_cast<size_t>(1000));
+
+    // a background reclaimer frees everything on its own thread
+    auto background = std::make_shared<NodeReclaimer>(NodeReclaimer::Background);
+    EXPECT_EQ(static_cast<int>(background->mode()), static_cast<int>(NodeReclaimer::Background));
+    for (int round = 0; round < 5; ++round) {
+        WAVLTree w;
+        w.setReclaimer(background);
+        for (int i = 0; i < 20000; ++i) w.insert(static_cast<ItemType>(i * 3));
+        if (round % 2) w.shrinkToFit();
+    }
+    for (int wait = 0; wait < 2000 && background->pendingNodes() > 0; ++wait)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(background->pendingNodes(), static_cast<size_t>(0));
+
+    // nodes held by a caller can still be walked while a background thread frees the rest of their old tree
+    for (int round = 0; round < 2; ++round) {
+        AVLTree w;
+        if (round == 0) w.setReclaimer(background);
+        for (int i = 0; i < 20000; ++i) w.insert(static_cast<ItemType>(i));
+        std::vector<std::shared_ptr<BinaryTreeNode>> held;
+        for (int i = 1; i < 20000; i += 997) held.push_back(w.find(static_cast<ItemType>(i)));
+        if (round == 0) {
+            w.clear();
+        } else {
+            // without a reclaimer the nodes replaced by compaction go to a background thread as well
+            for (int i = 0; i < 20000; i += 2) w.markDeleted(static_cast<ItemType>(i));
+            w.compact();
+        }
+        for (const auto& node : held) {
+            ItemType previous = node->item();
+            for (auto next = w.nextLargestNode(node); next != nullptr; next = w.nextLargestNode(next)) {
+                EXPECT_TRUE(previous < next->item());
+                previous = next->item();
+            }
+            for (auto next = w.nextSmallestNode(node); next != nullptr; next = w.nextSmallestNode(next)) {
+                EXPECT_TRUE(next->item() < node->item());
+            }
+        }
+    }
+}
+
+static void test_tombstones_and_compaction() {
+    std::cout << "\n== test_tombstones_and_compaction ==\n";
+    AVLTree t;
+    for (int i = 1; i <= 10; ++i) t.insert(static_cast<ItemType>(i));
+    int height = t.height();
+
+    // tombstones stay in place but are invisible
+    EXPECT_TRUE(t.markDeleted(1));
+    EXPECT_TRUE(t.markDeleted(5));
+    EXPECT_TRUE(t.markDeleted(10));
+    EXPECT_TRUE(!t.markDeleted(5));
+    EXPECT_TRUE(!t.markDeleted(42));
+    EXPECT_EQ(t.tombstoneCount(), static_cast<size_t>(3));
+    EXPECT_EQ(t.count(), static_cast<size_t>(7));
+    EXPECT_EQ(t.nodeCount(), static_cast<size_t>(10));
+    EXPECT_EQ(t.height(), height);
+    EXPECT_TRUE(t.find(5) == nullptr);
+    EXPECT_EQ(t.count(5), static_cast<size_t>(0));
+    EXPECT_EQ(t.minimumNode()->item(), static_cast<ItemType>(2));
+    EXPECT_EQ(t.maximumNode()->item(), static_cast<ItemType>(9));
+    EXPECT_EQ(t.nextLargestNode(t.find(4))->item(), static_cast<ItemType>(6));
+    EXPECT_EQ(t.nextSmallestNode(t.find(6))->item(), static_cast<ItemType>(4));
+    EXPECT_TRUE(t.nextLargestNode(t.find(9)) == nullptr);
+    std::vector<ItemType> live = { 2, 3, 4, 6, 7, 8, 9 };
+    EXPECT_VEC_EQ(t.inorder(), live, "inorder skips tombstones");
+    std::vector<ItemType> iterated;
+    for (ItemType item : t) iterated.push_back(item);
+    EXPECT_VEC_EQ(iterated, live, "iteration skips tombstones");
+    EXPECT_EQ(t.mapReduce<size_t>([](const ItemType&) { return static_cast<size_t>(1); }, [](size_t a, size_t b) { return a + b; }, 0), static_cast<size_t>(7));
+
+    // erasing a tombstone fails, inserting revives it
+    EXPECT_TRUE(!t.eraseOne(5));
+    t.insert(5);
+    EXPECT_EQ(t.tombstoneCount(), static_cast<size_t>(2));
+    EXPECT_EQ(t.count(), static_cast<size_t>(8));
+    EXPECT_TRUE(t.find(5) != nullptr);
+
+    // a batch removes tombstones on its path
+    t.applyBatch({ { BatchOperation::Insert, 1 }, { BatchOperation::Erase, 10 } });
+    EXPECT_EQ(t.tombstoneCount(), static_cast<size_t>(0));
+    EXPECT_EQ(t.nodeCount(), static_cast<size_t>(9));
+    EXPECT_VEC_EQ(t.inorder(), std::vector<ItemType>({ 1, 2, 3, 4, 5, 6, 7, 8, 9 }), "inorder after batch");
+
+    // every copy of a multiset item is deleted at once
+    AVLTree multi(true);
+    for (int i = 0; i < 30; ++i) multi.insert(static_cast<ItemType>(i % 3));
+    EXPECT_TRUE(multi.markDeleted(1));
+    EXPECT_EQ(multi.count(), static_cast<size_t>(20));
+    multi.insert(1);
+    EXPECT_EQ(multi.count(1), static_cast<size_t>(1));
+
+    // digests only cover live items
+    AVLTree hashed;
+    AVLTree reference;
+    hashed.enableHashing();
+    reference.enableHashing();
+    for (int i = 0; i < 1000; ++i) {
+        hashed.insert(static_cast<ItemType>(i));
+        if (i % 4) reference.insert(static_cast<ItemType>(i));
+    }
+    for (int i = 0; i < 1000; i += 4) hashed.markDeleted(static_cast<ItemType>(i));
+    EXPECT_EQ(hashed.rootHash(), reference.rootHash());
+    EXPECT_TRUE(hashed.diff(reference).empty());
+
+    // synchronous compaction rebuilds a balanced tree of the live items
+    hashed.compact();
+    EXPECT_EQ(hashed.tombstoneCount(), static_cast<size_t>(0));
+    EXPECT_TRUE(!hashed.isCompacting());
+    EXPECT_EQ(hashed.count(), static_cast<size_t>(750));
+    EXPECT_EQ(hashed.height(), 9);
+    EXPECT_EQ(hashed.rootHash(), reference.rootHash());
+    EXPECT_VEC_EQ(hashed.inorder(), reference.inorder(), "inorder after compact");
+
+    // the threshold triggers compaction, which is swapped in with the modifications made while it ran
+    for (int round = 0; round < 2; ++round) {
+        WAVLTree w;
+        std::set<ItemType> expected;
+        w.setCompactionThreshold(0.25, round == 0);
+        uint32_t state = 7;
+        for (int i = 0; i < 20000; ++i) {
+            w.insert(static_cast<ItemType>(i));
+            expected.insert(static_cast<ItemType>(i));
+        }
+        bool compacted = false;
+        for (int i = 0; i < 20000; ++i) {
+            state = state * 1103515245u + 12345u;
+            ItemType item = static_cast<ItemType>((state >> 8) % 20000);
+            switch (i % 3) {
+            case 0: EXPECT_EQ(w.markDeleted(item), expected.erase(item) > 0); break;
+            case 1: EXPECT_EQ(w.eraseOne(item), expected.erase(item) > 0); break;
+            default: w.insert(item); expected.insert(item); break;
+            }
+            compacted = compacted || w.isCompacting();
+            EXPECT_TRUE(w.tombstoneCount() <= w.count() / 2 + 64);
+            EXPECT_EQ(w.nodeCount(), w.count() + w.tombstoneCount());
+        }
+        w.compact();
+        EXPECT_TRUE(compacted || round == 1);
+        EXPECT_EQ(w.tombstoneCount(), static_cast<size_t>(0));
+        EXPECT_EQ(w.count(), expected.size());
+        EXPECT_VEC_EQ(w.inorder(), std::vector<ItemType>(expected.begin(), expected.end()), "inorder after threshold compaction");
+    }
+
+    // the following modifications copy the live items a few at a time; those of items already copied are replayed on the result, later ones are copied in their new state
+    {
+        // a multiset, so a modification replayed on top of the state it was copied in would count twice
+        AVLTree c(true);
+        std::multiset<ItemType> expected;
+        c.setCompactionThreshold(0.1);
+        for (int i = 0; i < 10000; ++i) {
+            c.insert(static_cast<ItemType>(i));
+            expected.insert(static_cast<ItemType>(i));
+        }
+        for (int i = 0; !c.isCompacting(); i += 2) {
+            c.markDeleted(static_cast<ItemType>(i));
+            expected.erase(static_cast<ItemType>(i));
+        }
+        // the first modification copies the smallest live items, the second the next ones
+        c.insert(0);
+        expected.insert(0);
+        EXPECT_TRUE(c.markDeleted(3));
+        EXPECT_TRUE(c.eraseOne(5));
+        EXPECT_TRUE(c.markDeleted(9000));
+        EXPECT_TRUE(c.eraseOne(9001));
+        c.insert(20000);
+        c.insert(20000);
+        expected.insert(20000);
+        c.applyBatch({ { BatchOperation::Erase, 7 }, { BatchOperation::Insert, 2 }, { BatchOperation::Erase, 9002 }, { BatchOperation::Insert, 20001 } });
+        for (ItemType item : { 3, 5, 9000, 9001, 7, 9002 }) expected.erase(item);
+        for (ItemType item : { 20000, 2, 20001 }) expected.insert(item);
+        EXPECT_TRUE(c.isCompacting());
+        EXPECT_VEC_EQ(c.inorder(), std::vector<ItemType>(expected.begin(), expected.end()), "inorder while copying");
+        for (int wait = 0; wait < 2000 && c.isCompacting(); ++wait) {
+            c.insert(static_cast<ItemType>(30000 + wait));
+            expected.insert(static_cast<ItemType>(30000 + wait));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_TRUE(!c.isCompacting());
+        EXPECT_EQ(c.count(), expected.size());
+        EXPECT_EQ(c.nodeCount(), std::set<ItemType>(expected.begin(), expected.end()).size() + c.tombstoneCount());
+        EXPECT_VEC_EQ(c.inorder(), std::vector<ItemType>(expected.begin(), expected.end()), "inorder after incremental compaction");
+        EXPECT_EQ(c.count(20000), static_cast<size_t>(2));
+    }
+
+    // a rebuild that takes long enough for a long log gets the log merged into its result on its own thread before it is swapped in
+    {
+        AVLTree big;
+        std::set<ItemType> expected;
+        big.setCompactionThreshold(0.2);
+        const int n = 200000;
+        for (int i = 0; i < n; ++i) {
+            big.insert(static_cast<ItemType>(i));
+            expected.insert(static_cast<ItemType>(i));
+        }
+        uint32_t state = 11;
+        bool started = false;
+        for (int i = 0; i < 2000000 && !(started && !big.isCompacting()); ++i) {
+            state = state * 1103515245u + 12345u;
+            ItemType item = static_cast<ItemType>((state >> 8) % n);
+            if (i % 2) {
+                EXPECT_EQ(big.markDeleted(item), expected.erase(item) > 0);
+            } else {
+                big.insert(item);
+                expected.insert(item);
+            }
+            started = started || big.isCompacting();
+        }
+        EXPECT_TRUE(started && !big.isCompacting());
+        EXPECT_EQ(big.count(), expected.size());
+        EXPECT_EQ(big.nodeCount(), big.count() + big.tombstoneCount());
+        EXPECT_VEC_EQ(big.inorder(), std::vector<ItemType>(expected.begin(), expected.end()), "inorder after merging a long log");
+    }
+
+    // clearing a tree while its rebuild runs does not wait for it; the result is handed to the reclaimer once it is built
+    {
+        auto reclaimer = std::make_shared<NodeReclaimer>(NodeReclaimer::Incremental);
+        AVLTree c;
+        c.setReclaimer(reclaimer);
+        c.setCompactionThreshold(0.25);
+        for (int i = 0; i < 100000; ++i) c.insert(static_cast<ItemType>(i));
+        for (int i = 0; !c.isCompacting(); i += 2) c.markDeleted(static_cast<ItemType>(i));
+        // every modification copies 256 live items, and the one that finds fewer starts the rebuild
+        size_t live = c.count();
+        for (size_t step = 0; step <= live / 256; ++step) c.insert(1);
+        EXPECT_TRUE(c.isCompacting());
+        size_t nodes = c.nodeCount();
+        c.clear();
+        EXPECT_TRUE(!c.isCompacting());
+        for (int wait = 0; wait < 5000 && reclaimer->pendingNodes() < nodes + live; ++wait)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        EXPECT_EQ(reclaimer->pendingNodes(), nodes + live);
+        reclaimer->drain();
+
+        // without a reclaimer the result is freed on that thread, and destruction does not wait either
+        AVLTree d;
+        d.setCompactionThreshold(0.25);
+        for (int i = 0; i < 100000; ++i) d.insert(static_cast<ItemType>(i));
+        for (int i = 0; !d.isCompacting(); i += 2) d.markDeleted(static_cast<ItemType>(i));
+        for (size_t step = 0; step <= d.count() / 256; ++step) d.insert(1);
+        EXPECT_TRUE(d.isCompacting());
+    }
+
+    // tombstone nodes are reclaimed and counted like any other
+    auto incremental = std::make_shared<NodeReclaimer>(NodeReclaimer::Incremental, 1000000, 16);
+    {
+        AVLTree r;
+        r.setReclaimer(incremental);
+        for (int i = 0; i < 100; ++i) r.insert(static_cast<ItemType>(i));
+        for (int i = 0; i < 100; ++i) r.markDeleted(static_cast<ItemType>(i));
+        EXPECT_EQ(r.count(), static_cast<size_t>(0));
+        EXPECT_EQ(r.nodeCount(), static_cast<size_t>(100));
+    }
+    EXPECT_EQ(incremental->pendingNodes(), static_cast<size_t>(100));
+    EXPECT_EQ(incremental->reclaim(1000), static_cast<size_t>(100));
+    EXPECT_EQ(incremental->reclaim(1000), static_cast<size_t>(0));
+
+    // so they are held to the cap as well
+    auto capped = std::make_shared<NodeReclaimer>(NodeReclaimer::Incremental, 50);
+    {
+        AVLTree r;
+        r.setReclaimer(capped);
+        for (int i = 0; i < 100; ++i) r.insert(static_cast<ItemType>(i));
+        for (int i = 0; i < 100; ++i) r.markDeleted(static_cast<ItemType>(i));
+    }
+    EXPECT_EQ(capped->pendingNodes(), static_cast<size_t>(50));
+}
+
 // ---------------- main ----------------
 int main() {
     std::cout << "Running AVLTree tests (extended + nullptr coverage)…\n";
@@ -428,6 +1487,32 @@ int main() {
     catch (const std::exception& e) { std::cerr << "EXC in test_extreme_values: " << e.what() << "\n"; failures++; }
     try { test_duplicates_observation(); }
     catch (const std::exception& e) { std::cerr << "EXC in test_duplicates_observation: " << e.what() << "\n"; failures++; }
+    try { test_parallel_export_and_map_reduce(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_parallel_export_and_map_reduce: " << e.what() << "\n"; failures++; }
+    try { test_memory_usage_and_shrink_to_fit(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_memory_usage_and_shrink_to_fit: " << e.what() << "\n"; failures++; }
+    try { test_multiset_mode(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_multiset_mode: " << e.what() << "\n"; failures++; }
+    try { test_erase_keeps_balance(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_erase_keeps_balance: " << e.what() << "\n"; failures++; }
+    try { test_find_cache(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_find_cache: " << e.what() << "\n"; failures++; }
+    try { test_block_tree_against_std_set(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_block_tree_against_std_set: " << e.what() << "\n"; failures++; }
+    try { test_hash_diff_and_delta_sync(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_hash_diff_and_delta_sync: " << e.what() << "\n"; failures++; }
+    try { test_apply_batch_matches_sequential(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_apply_batch_matches_sequential: " << e.what() << "\n"; failures++; }
+    try { test_weak_avl_policy(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_weak_avl_policy: " << e.what() << "\n"; failures++; }
+    try { test_trace_record_and_read(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_trace_record_and_read: " << e.what() << "\n"; failures++; }
+    try { test_static_tree(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_static_tree: " << e.what() << "\n"; failures++; }
+    try { test_deferred_reclamation(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_deferred_reclamation: " << e.what() << "\n"; failures++; }
+    try { test_tombstones_and_compaction(); }
+    catch (const std::exception& e) { std::cerr << "EXC in test_tombstones_and_compaction: " << e.what() << "\n"; failures++; }
 
     if (failures == 0) {
         std::cout << "\nAll tests PASSED\n";
@@ -0,0 +1,174 @@
+// replay.cpp — re-runs a recorded workload trace against a tree configuration and reports throughput and latency percentiles
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "AVLTree.hpp"
+#include "TraceRecorder.hpp"
+
+struct ReplayOptions {
+    std::string policy = "avl";
+    size_t findCacheSlots = 0;
+    bool hashing = false;
+    bool multiset = false;
+    double compaction = 0;
+    size_t repeat = 1;
+};
+
+struct ReplayResult {
+    /// latencies in nanoseconds, one vector per event kind
+    std::vector<std::vector<uint64_t>> latencies = std::vector<std::vector<uint64_t>>(TraceEvent::KindCount);
+    /// time spent inside the replayed operations
+    double seconds = 0;
+    /// successor/predecessor events whose node was no longer in the tree and which were skipped
+    size_t skipped = 0;
+    /// sum of results, so the compiler cannot drop the operations
+    uint64_t sink = 0;
+};
+
+template <typename Tree>
+static void replay_once(const std::vector<TraceEvent>& events, const ReplayOptions& options, ReplayResult& result) {
+    Tree t(options.multiset);
+    if (options.hashing) t.enableHashing();
+    if (options.findCacheSlots > 0) t.enableFindCache(options.findCacheSlots);
+    if (options.compaction > 0) t.setCompactionThreshold(options.compaction);
+    std::vector<ItemType> buffer;
+    for (const auto& event : events) {
+        std::shared_ptr<BinaryTreeNode> node;
+        // a successor query needs the node it starts from; looking it up is not part of the timed operation, so it bypasses the find cache to leave its contents and hit counts to the timed finds
+        if (event.kind == TraceEvent::NextLargest || event.kind == TraceEvent::NextSmallest) {
+            node = t.findUncached(event.item);
+            if (!node) {
+                result.skipped++;
+                continue;
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        switch (event.kind) {
+        case TraceEvent::Insert: t.insert(event.item); break;
+        case TraceEvent::Erase: result.sink += t.eraseOne(event.item); break;
+        case TraceEvent::Find: result.sink += t.find(event.item) != nullptr; break;
+        case TraceEvent::NextLargest: result.sink += t.nextLargestNode(node) != nullptr; break;
+        case TraceEvent::NextSmallest: result.sink += t.nextSmallestNode(node) != nullptr; break;
+        case TraceEvent::Minimum: result.sink += t.minimumNode() != nullptr; break;
+        case TraceEvent::Maximum: result.sink += t.maximumNode() != nullptr; break;
+        case TraceEvent::Inorder:
+            buffer.resize(t.count());
+            t.exportInorder(buffer.data());
+            result.sink += buffer.size();
+            break;
+        case TraceEvent::Preorder: result.sink += t.preorder().size(); break;
+        case TraceEvent::Postorder: result.sink += t.postorder().size(); break;
+        case TraceEvent::ForEach: {
+            std::atomic<size_t> visited(0);
+            t.forEach([&](const ItemType&) { visited.fetch_add(1, std::memory_order_relaxed); });
+            result.sink += visited;
+            break;
+        }
+        case TraceEvent::Clear: t.clear(); break;
+        case TraceEvent::MarkDeleted: result.sink += t.markDeleted(event.item); break;
+        default: break;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        result.seconds += elapsed.count();
+        result.latencies[event.kind].push_back(static_cast<uint64_t>(elapsed.count() * 1e9));
+    }
+}
+
+template <typename Tree>
+static ReplayResult replay(const std::vector<TraceEvent>& events, const ReplayOptions& options) {
+    ReplayResult result;
+    for (size_t pass = 0; pass < options.repeat; ++pass)
+        replay_once<Tree>(events, options, result);
+    return result;
+}
+
+/// returns the latency below which the fraction p of the sorted latencies lie
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static void print_row(const std::string& label, std::vector<uint64_t>& latencies) {
+    if (latencies.empty()) return;
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (auto latency : latencies) total += static_cast<double>(latency);
+    std::cout << std::left << std::setw(14) << label << std::right
+        << std::setw(12) << latencies.size()
+        << std::setw(10) << static_cast<uint64_t>(total / latencies.size())
+        << std::setw(10) << percentile(latencies, 0.50)
+        << std::setw(10) << percentile(latencies, 0.90)
+        << std::setw(10) << percentile(latencies, 0.99)
+        << std::setw(10) << percentile(latencies, 0.999)
+        << std::setw(12) << latencies.back() << "\n";
+}
+
+static void print_report(ReplayResult& result) {
+    std::vector<uint64_t> all;
+    for (const auto& latencies : result.latencies) all.insert(all.end(), latencies.begin(), latencies.end());
+    std::cout << "operations  " << all.size() << " (" << result.skipped << " skipped)\n";
+    std::cout << "time        " << std::fixed << std::setprecision(3) << result.seconds * 1e3 << " ms\n";
+    std::cout << "throughput  " << std::setprecision(0) << (result.seconds > 0 ? all.size() / result.seconds : 0) << " ops/s\n\n";
+    std::cout << std::left << std::setw(14) << "latency (ns)" << std::right << std::setw(12) << "count"
+        << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90"
+        << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(12) << "max" << "\n";
+    for (int kind = 0; kind < TraceEvent::KindCount; ++kind)
+        print_row(traceKindName(static_cast<TraceEvent::Kind>(kind)), result.latencies[kind]);
+    print_row("all", all);
+}
+
+static void usage(const char* program) {
+    std::cerr << "usage: " << program << " TRACE [--policy avl|wavl] [--find-cache SLOTS] [--hashing] [--multiset] [--compaction FRACTION] [--repeat N]\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    ReplayOptions options;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--policy" && i + 1 < argc) options.policy = argv[++i];
+        else if (arg == "--find-cache" && i + 1 < argc) options.findCacheSlots = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--hashing") options.hashing = true;
+        else if (arg == "--multiset") options.multiset = true;
+        else if (arg == "--compaction" && i + 1 < argc) options.compaction = std::strtod(argv[++i], nullptr);
+        else if (arg == "--repeat" && i + 1 < argc) options.repeat = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.policy != "avl" && options.policy != "wavl") {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << argv[1] << "\n";
+        return 1;
+    }
+    std::vector<TraceEvent> events;
+    if (!readTrace(in, events)) {
+        std::cerr << argv[1] << " is not a valid trace\n";
+        return 1;
+    }
+
+    std::cout << "trace       " << argv[1] << ", " << events.size() << " events\n";
+    std::cout << "policy      " << options.policy << ", find cache " << options.findCacheSlots
+        << (options.hashing ? ", hashing" : "") << (options.multiset ? ", multiset" : "")
+        << ", compaction " << options.compaction
+        << ", " << options.repeat << " pass(es)\n";
+    ReplayResult result = options.policy == "wavl" ? replay<WAVLTree>(events, options) : replay<AVLTree>(events, options);
+    print_report(result);
+    return result.sink == static_cast<uint64_t>(-1) ? 2 : 0;
+}